@@ -18,10 +18,13 @@ using namespace std;
 /*
  * BTreeIndex constructor
  */
-BTreeIndex::BTreeIndex()
+template <class Key>
+BTreeIndex<Key>::BTreeIndex()
 {
     rootPid = -1;
     treeHeight=0;
+    leafNext = leafEnd = 0;
+    nonLeafNext = nonLeafEnd = 0;
 }
 
 /*
@@ -29,23 +32,39 @@ BTreeIndex::BTreeIndex()
  * Under 'w' mode, the index file should be created if it does not exist.
  * @param indexname[IN] the name of the index file
  * @param mode[IN] 'r' for read, 'w' for write
+ * @param flags[IN] PageFile option flags (e.g., PageFile::WRITE_BACK)
+ * @param pageSize[IN] the page size of the index file if it is created
  * @return error code. 0 if no error
  */
-RC BTreeIndex::open(const string& indexname, char mode)
+template <class Key>
+RC BTreeIndex<Key>::open(const string& indexname, char mode, int flags, int pageSize)
 {
-    pf.open(indexname,mode);
+    RC rc;
 
-    if (pf.endPid()==0){
-        rootPid=-1;
-        treeHeight=0;
+    rootPid=-1;
+    treeHeight=0;
+    if ((rc = pf.open(indexname,mode,flags,pageSize)) < 0) return rc;
 
+    // new nodes go to new extents after the existing pages
+    leafNext = leafEnd = 0;
+    nonLeafNext = nonLeafEnd = 0;
+
+    if (pf.endPid()==0){
         memcpy(buffer,&rootPid ,sizeof(int));
         memcpy(buffer+4, &treeHeight ,sizeof(int));
-        pf.write(0,buffer);  // write to add the first page ( pf.eid++ )
+        // write to add the first page ( pf.eid++ ). an empty file
+        // opened for reading is read as an empty tree
+        if ((mode == 'w' || mode == 'W') && (rc = pf.write(0,buffer)) < 0) {
+            pf.close();
+            return rc;
+        }
 
     }
     else{
-        pf.read(0,buffer);
+        if ((rc = pf.read(0,buffer)) < 0) {
+            pf.close();
+            return rc;
+        }
         memcpy(&rootPid, buffer, sizeof(int));   // the root pid from the page0
         memcpy(&treeHeight, buffer+4, sizeof(int)); // get the tree height from page0
 
@@ -59,7 +78,8 @@ RC BTreeIndex::open(const string& indexname, char mode)
  * Close the index file.
  * @return error code. 0 if no error
  */
-RC BTreeIndex::close()
+template <class Key>
+RC BTreeIndex<Key>::close()
 {
     memcpy(buffer,&rootPid ,sizeof(int));
     memcpy(buffer+4, &treeHeight ,sizeof(int));
@@ -68,18 +88,32 @@ RC BTreeIndex::close()
     return pf.close();
 }
 
+template <class Key>
+RC BTreeIndex<Key>::commit()
+{
+    RC rc;
+
+    // the root and the height of the tree have to be durable as well
+    memcpy(buffer,&rootPid ,sizeof(int));
+    memcpy(buffer+4, &treeHeight ,sizeof(int));
+    if ((rc = pf.write(0,buffer)) < 0) return rc;
+
+    return pf.commit();
+}
+
 /*
  * Insert (key, RecordId) pair to the index.
  * @param key[IN] the key for the value inserted into the index
  * @param rid[IN] the RecordId for the record being inserted into the index
  * @return error code. 0 if no error
  */
-RC BTreeIndex::insert(int key, const RecordId& rid)
+template <class Key>
+RC BTreeIndex<Key>::insert(const Key& key, const RecordId& rid)
 {
 
     if (treeHeight==0){
-        BTLeafNode newroot;
-        rootPid = pf.endPid();
+        BTLeafNode<Key> newroot(pf.getPageSize());
+        rootPid = newNodePid(true);
         newroot.insert(key,rid);
         treeHeight++;
 
@@ -89,16 +123,16 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
 
     }
     else{
-        int toaddedkey = -1;
-        int toaddedpid = -1;
+        Key toaddedkey = Key();
+        PageId toaddedpid = -1;
 
         insertRec(rootPid,1,key,rid,toaddedkey,toaddedpid);
 
 
-        if (toaddedkey!=-1 && toaddedpid!=-1){
+        if (toaddedpid!=-1){
 
-            BTNonLeafNode newroot;
-            int newrootpid = pf.endPid();
+            BTNonLeafNode<Key> newroot(pf.getPageSize());
+            int newrootpid = newNodePid(false);
 
             newroot.initializeRoot(rootPid,toaddedkey,toaddedpid );
 
@@ -114,11 +148,26 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
     return 0;
 }
 
-RC BTreeIndex::insertRec( int curpid,int curheight, int key, const RecordId& rid , int& addedkey, int& addedpid ){
+template <class Key>
+PageId BTreeIndex<Key>::newNodePid(bool leaf)
+{
+    PageId& next = leaf ? leafNext : nonLeafNext;
+    PageId& end = leaf ? leafEnd : nonLeafEnd;
+
+    if (next >= end) {
+        int count = leaf ? LEAF_EXTENT : NONLEAF_EXTENT;
+        if (pf.allocate(count, next) < 0) return pf.endPid();
+        end = next + count;
+    }
+    return next++;
+}
+
+template <class Key>
+RC BTreeIndex<Key>::insertRec( PageId curpid,int curheight, const Key& key, const RecordId& rid , Key& addedkey, PageId& addedpid ){
 
     if (curheight==treeHeight){
 
-        BTLeafNode leafNode;
+        BTLeafNode<Key> leafNode(pf.getPageSize());
         leafNode.read(curpid,pf);
         int error = leafNode.insert(key,rid);
 
@@ -132,8 +181,8 @@ RC BTreeIndex::insertRec( int curpid,int curheight, int key, const RecordId& rid
 
 
 
-            BTLeafNode newsibling;
-            int newsiblingpid = pf.endPid();
+            BTLeafNode<Key> newsibling(pf.getPageSize());
+            int newsiblingpid = newNodePid(true);
             //newsibling.write(newsiblingpid,pf);
 
             /// update addedkey and addedpid for upper level to insert
@@ -156,28 +205,29 @@ RC BTreeIndex::insertRec( int curpid,int curheight, int key, const RecordId& rid
     }
     else{
 
-        BTNonLeafNode nonLeafNode;
+        BTNonLeafNode<Key> nonLeafNode(pf.getPageSize());
         nonLeafNode.read(curpid,pf);
 
-        int toaddedkey = -1;
-        int toaddedpid = -1;
+        Key toaddedkey = Key();
+        PageId toaddedpid = -1;
 
-        int childpid = -1;
+        PageId childpid = -1;
         nonLeafNode.locateChildPtr(key, childpid);
 
 
         insertRec(childpid,curheight+1,key,rid,toaddedkey,toaddedpid);
 
 
-        if (toaddedkey!=-1 && toaddedpid!=-1){
+        if (toaddedpid!=-1){
 
-            int error = nonLeafNode.insert(toaddedkey,toaddedpid);
+            // the new child goes right behind the child it split from
+            int error = nonLeafNode.insert(toaddedkey,toaddedpid,childpid);
             if (error!=0){    /// when insert return wrong, we use insertandsplit instead
 
-                BTNonLeafNode newsibling;
-                int newsiblingpid = pf.endPid();
+                BTNonLeafNode<Key> newsibling(pf.getPageSize());
+                int newsiblingpid = newNodePid(false);
 
-                nonLeafNode.insertAndSplit(toaddedkey,toaddedpid,newsibling,addedkey);
+                nonLeafNode.insertAndSplit(toaddedkey,toaddedpid,newsibling,addedkey,childpid);
                 addedpid=newsiblingpid;
 
                 newsibling.write(newsiblingpid,pf);
@@ -195,6 +245,35 @@ RC BTreeIndex::insertRec( int curpid,int curheight, int key, const RecordId& rid
 
 
 
+template <class Key>
+RC BTreeIndex<Key>::remove(const Key& key, const RecordId& rid)
+{
+    IndexCursor cursor;
+    Key         k;
+    RecordId    r;
+
+    if (treeHeight==0) return RC_NO_SUCH_RECORD;
+    locate(key,cursor);
+
+    // the entries with the key may continue into the next leaves
+    BTLeafNode<Key> leafnode(pf.getPageSize());
+    while (cursor.pid > 0){
+        leafnode.read(cursor.pid,pf);
+        for (; cursor.eid <= leafnode.getKeyCount(); cursor.eid++){
+            leafnode.readEntry(cursor.eid,k,r);
+            if (k > key) return RC_NO_SUCH_RECORD;
+            if (k == key && r == rid){
+                leafnode.remove(cursor.eid);
+                return leafnode.write(cursor.pid,pf);
+            }
+        }
+        cursor.pid = leafnode.getNextNodePtr();
+        cursor.eid = 1;
+    }
+
+    return RC_NO_SUCH_RECORD;
+}
+
 /**
  * Run the standard B+Tree key search algorithm and identify the
  * leaf node where searchKey may exist. If an index entry with
@@ -213,14 +292,15 @@ RC BTreeIndex::insertRec( int curpid,int curheight, int key, const RecordId& rid
  *                    smaller than searchKey.
  * @return 0 if searchKey is found. Othewise an error code
  */
-RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
+template <class Key>
+RC BTreeIndex<Key>::locate(const Key& searchKey, IndexCursor& cursor)
 {
     if (treeHeight==0) return -1;
 
     int curheight=1;   // if c<1   error
     int curpid=rootPid;
-    BTNonLeafNode nonleafNode;
-    BTLeafNode leafNode;
+    BTNonLeafNode<Key> nonleafNode(pf.getPageSize());
+    BTLeafNode<Key> leafNode(pf.getPageSize());
 
     while (curheight!=treeHeight){
         nonleafNode.read(curpid,pf);
@@ -231,7 +311,17 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
     leafNode.read(curpid,pf);
     cursor.pid=curpid;
 
-    return leafNode.locate(searchKey,cursor.eid);
+    // a key equal to a separator leads to the left child, but it may
+    // start the next leaf (or one after leaves emptied by deletions)
+    RC rc = leafNode.locate(searchKey,cursor.eid);
+    while (rc != 0 && cursor.eid > leafNode.getKeyCount()){
+        PageId next = leafNode.getNextNodePtr();
+        if (next <= 0) break;
+        leafNode.read(next,pf);
+        cursor.pid=next;
+        rc = leafNode.locate(searchKey,cursor.eid);
+    }
+    return rc;
 
 
 }
@@ -246,11 +336,23 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
  * @param rid[OUT] the RecordId stored at the index cursor location.
  * @return error code. 0 if no error
  */
-RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
+template <class Key>
+RC BTreeIndex<Key>::readForward(IndexCursor& cursor, Key& key, RecordId& rid)
 {
 
-    BTLeafNode leafnode;
+    BTLeafNode<Key> leafnode(pf.getPageSize());
+    if (cursor.pid <= 0) return RC_END_OF_TREE;
     leafnode.read(cursor.pid,pf);
+
+    // the cursor may be past the end of its leaf, and deletions may have
+    // left leaves empty. move on to the next leaf with an entry
+    while (cursor.eid > leafnode.getKeyCount()) {
+        cursor.pid = leafnode.getNextNodePtr();
+        cursor.eid = 1;
+        if (cursor.pid <= 0) return RC_END_OF_TREE;
+        leafnode.read(cursor.pid,pf);
+    }
+
     leafnode.readEntry(cursor.eid,key,rid);
     cursor.eid++;
     if (cursor.eid>leafnode.getKeyCount() ){
@@ -264,14 +366,15 @@ RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
 }
 
 
-void BTreeIndex::print()
+template <class Key>
+void BTreeIndex<Key>::print()
 {
 
 
     cout<<treeHeight<<"treeHeight"<<endl;
 	if(treeHeight==1)
 	{
-		BTLeafNode root;
+		BTLeafNode<Key> root(pf.getPageSize());
 		root.read(rootPid, pf);
 		root.print();
 	}
@@ -293,7 +396,7 @@ void BTreeIndex::print()
                 for (int i=0;i<size;i++) {
                     int curpid = q.front();
                     q.pop();
-                    BTLeafNode node;
+                    BTLeafNode<Key> node(pf.getPageSize());
                     node.read(curpid,pf);
                     node.print();
                 }
@@ -303,13 +406,13 @@ void BTreeIndex::print()
                 for (int i=0;i<size;i++){
                     int curpid = q.front();
                     q.pop();
-                    BTNonLeafNode node;
+                    BTNonLeafNode<Key> node(pf.getPageSize());
                     node.read(curpid,pf);
                     node.print();
                     for(int i=0; i<node.getKeyCount()+1; i++)
                     {
-                        int rest;
-                        memcpy(&rest, node.buffer+4+(8*i), sizeof(PageId));
+                        PageId rest;
+                        memcpy(&rest, node.page+sizeof(int)+BTNonLeafNode<Key>::PAIR_SIZE*i, sizeof(PageId));
                         q.push(rest);
                     }
 
@@ -322,3 +425,6 @@ void BTreeIndex::print()
 	}
 }
 
+template class BTreeIndex<int>;
+template class BTreeIndex<long long>;
+template class BTreeIndex<FixedKey<16> >;
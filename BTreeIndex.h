@@ -30,8 +30,10 @@ typedef struct {
 
 /**
  * Implements a B-Tree index for bruinbase.
- * 
+ * Key is the type of the keys (see BTreeNode.h). The key column of a
+ * table is indexed by a BTreeIndex<int>.
  */
+template <class Key>
 class BTreeIndex {
  public:
   BTreeIndex();
@@ -41,15 +43,25 @@ class BTreeIndex {
    * Under 'w' mode, the index file should be created if it does not exist.
    * @param indexname[IN] the name of the index file
    * @param mode[IN] 'r' for read, 'w' for write
+   * @param flags[IN] PageFile option flags (e.g., PageFile::WRITE_BACK)
+   * @param pageSize[IN] the page size of the index file if it is created.
+   *                     larger pages give the nodes a larger fanout
    * @return error code. 0 if no error
    */
-  RC open(const std::string& indexname, char mode);
+  RC open(const std::string& indexname, char mode, int flags = 0,
+          int pageSize = PageFile::PAGE_SIZE);
 
   /**
    * Close the index file.
    * @return error code. 0 if no error
    */
   RC close();
+
+  /**
+   * Make the insertions so far durable (see PageFile::commit()).
+   * @return error code. 0 if no error
+   */
+  RC commit();
     
   /**
    * Insert (key, RecordId) pair to the index.
@@ -57,11 +69,28 @@ class BTreeIndex {
    * @param rid[IN] the RecordId for the record being inserted into the index
    * @return error code. 0 if no error
    */
-  RC insert(int key, const RecordId& rid);
+  RC insert(const Key& key, const RecordId& rid);
 
 
 
-  RC insertRec(int curpid,int curheight, int key, const RecordId& rid , int& addedkey, int& addedpid );
+  /**
+   * Insert (key, RecordId) pair to the subtree at curpid.
+   * When the node splits, addedkey and addedpid are set to the key and
+   * the PageId of the new sibling, which the parent has to insert.
+   * Otherwise addedpid is left as it is (-1).
+   */
+  RC insertRec(PageId curpid,int curheight, const Key& key, const RecordId& rid , Key& addedkey, PageId& addedpid );
+
+  /**
+   * Remove the (key, RecordId) pair from the index.
+   * The leaf keeps its place in the tree even if it becomes empty;
+   * readForward() skips empty leaves.
+   * @param key[IN] the key of the entry to remove
+   * @param rid[IN] the RecordId of the entry to remove
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the index
+   *         has no such entry
+   */
+  RC remove(const Key& key, const RecordId& rid);
 
 
   /**
@@ -82,7 +111,7 @@ class BTreeIndex {
    *                    smaller than searchKey.
    * @return 0 if searchKey is found. Othewise, an error code
    */
-  RC locate(int searchKey, IndexCursor& cursor);
+  RC locate(const Key& searchKey, IndexCursor& cursor);
 
   /**
    * Read the (key, rid) pair at the location specified by the index cursor,
@@ -90,9 +119,10 @@ class BTreeIndex {
    * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
    * @param key[OUT] the key stored at the index cursor location
    * @param rid[OUT] the RecordId stored at the index cursor location
-   * @return error code. 0 if no error
+   * @return error code. 0 if no error. RC_END_OF_TREE if the cursor is
+   *         past the last entry
    */
-  RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
+  RC readForward(IndexCursor& cursor, Key& key, RecordId& rid);
 
   void print();
 
@@ -101,7 +131,7 @@ class BTreeIndex {
 
 public:
 
-  char buffer[PageFile::PAGE_SIZE];   /// the buffer is used to store the b+tree height and root info in the first page
+  char buffer[PageFile::MAX_PAGE_SIZE];   /// the buffer is used to store the b+tree height and root info in the first page
 
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
   PageId   rootPid;    /// the PageId of the root node
@@ -110,6 +140,23 @@ public:
   /// this class is destructed. Make sure to store the values of the two 
   /// variables in disk, so that they can be reconstructed when the index
   /// is opened again later.
+
+private:
+  static const int LEAF_EXTENT = 64;    /// # pages reserved for leaves at a time
+  static const int NONLEAF_EXTENT = 8;  /// # pages reserved for non-leaf nodes at a time
+
+  /**
+   * get the page of a new node. leaves and non-leaf nodes are taken from
+   * separate extents of the file, so that the leaves created one after
+   * another (e.g., by the splits of a sorted load) are next to each
+   * other on disk and a range scan reads them sequentially.
+   * @param leaf[IN] true for a leaf node
+   * @return the PageId of the new node
+   */
+  PageId newNodePid(bool leaf);
+
+  PageId leafNext, leafEnd;       /// the unused pages of the extent of leaves
+  PageId nonLeafNext, nonLeafEnd; /// the unused pages of the extent of non-leaf nodes
 };
 
 #endif /* BTREEINDEX_H */
@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+//
+// checks that BTreeIndex::locate() finds every key in the index, for
+// each key type and for small and large pages. the keys repeat, so the
+// entries of a key span leaves, and every separator key of the non-leaf
+// nodes is looked up as well: a separator leads to the left child, while
+// the key it separates may start the right one. a third of the entries
+// are then removed, and the lookups are checked again.
+//
+// usage: btreetest
+//
+
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+static const char* INDEX_FILE = "btreetest.idx";
+
+static const int ENTRIES = 30000;
+static const int DISTINCT_KEYS[] = { 3, 500, 1000000 };
+
+// the key of the i'th distinct key value, in the same order
+template <class Key> Key makeKey(int i);
+template <> int makeKey<int>(int i) { return i - 1; }
+template <> long long makeKey<long long>(int i) { return (i - 1) * 5000000000LL; }
+template <> FixedKey<16> makeKey<FixedKey<16> >(int i)
+{
+  char s[32];
+  sprintf(s, "key%012d", i);
+  return FixedKey<16>(s);
+}
+
+// count the entries with the key from a locate() of it
+template <class Key>
+static int countKey(BTreeIndex<Key>& tree, const Key& key)
+{
+  IndexCursor cursor;
+  Key k;
+  RecordId rid;
+  int count = 0;
+
+  if (tree.locate(key, cursor) != 0) return -1;
+  while (tree.readForward(cursor, k, rid) == 0 && k == key) count++;
+  return count;
+}
+
+// look up every separator key of the non-leaf nodes under pid
+template <class Key>
+static int checkSeparators(BTreeIndex<Key>& tree, PageId pid, int height,
+                           const std::map<Key, int>& counts)
+{
+  if (height == tree.treeHeight) return 0;
+
+  BTNonLeafNode<Key> node(tree.pf.getPageSize());
+  node.read(pid, tree.pf);
+
+  const int pairSize = BTNonLeafNode<Key>::PAIR_SIZE;
+  const char* pairs = node.page + sizeof(int);
+  int errors = 0;
+
+  for (int i = 0; i <= node.getKeyCount(); i++) {
+    PageId child;
+    memcpy(&child, pairs + i * pairSize, sizeof(PageId));
+    errors += checkSeparators(tree, child, height + 1, counts);
+    if (i == node.getKeyCount()) break;
+
+    Key key;
+    memcpy(&key, pairs + i * pairSize + sizeof(PageId), sizeof(Key));
+    typename std::map<Key, int>::const_iterator it = counts.find(key);
+    if (it != counts.end() && it->second > 0 && countKey(tree, key) != it->second) errors++;
+  }
+  return errors;
+}
+
+// look up every key that has entries left
+template <class Key>
+static int checkKeys(BTreeIndex<Key>& tree, const std::map<Key, int>& counts)
+{
+  int errors = 0;
+  for (typename std::map<Key, int>::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+    if (it->second > 0 && countKey(tree, it->first) != it->second) errors++;
+  }
+  return errors;
+}
+
+template <class Key>
+static int run(const char* name, int pageSize, int distinct)
+{
+  std::mt19937 random(distinct);
+  std::map<Key, int> counts;
+  std::vector<std::pair<Key, RecordId> > entries;
+  BTreeIndex<Key> tree;
+
+  unlink(INDEX_FILE);
+  if (tree.open(INDEX_FILE, 'w', 0, pageSize) < 0) {
+    fprintf(stderr, "cannot create %s\n", INDEX_FILE);
+    return 1;
+  }
+
+  for (int i = 0; i < ENTRIES; i++) {
+    Key key = makeKey<Key>(random() % distinct);
+    RecordId rid = { i / 10, i % 10 };
+    tree.insert(key, rid);
+    counts[key]++;
+    entries.push_back(std::make_pair(key, rid));
+  }
+  int errors = checkKeys(tree, counts) +
+               checkSeparators(tree, tree.rootPid, 1, counts);
+
+  for (int i = 0; i < ENTRIES; i += 3) {
+    if (tree.remove(entries[i].first, entries[i].second) != 0) errors++;
+    else counts[entries[i].first]--;
+  }
+  errors += checkKeys(tree, counts) +
+            checkSeparators(tree, tree.rootPid, 1, counts);
+
+  printf("%-10s %6d %8d %7d %7d\n", name, pageSize, distinct, tree.treeHeight, errors);
+  tree.close();
+  unlink(INDEX_FILE);
+  return errors;
+}
+
+int main()
+{
+  int errors = 0;
+
+  printf("%-10s %6s %8s %7s %7s\n", "key", "page", "keys", "height", "errors");
+  for (int pageSize = PageFile::PAGE_SIZE; pageSize <= 8192; pageSize *= 8) {
+    for (int i = 0; i < 3; i++) {
+      errors += run<int>("int", pageSize, DISTINCT_KEYS[i]);
+      errors += run<long long>("long long", pageSize, DISTINCT_KEYS[i]);
+      errors += run<FixedKey<16> >("char[16]", pageSize, DISTINCT_KEYS[i]);
+    }
+  }
+
+  return errors == 0 ? 0 : 1;
+}
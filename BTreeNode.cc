@@ -6,18 +6,25 @@
 
 using namespace std;
 
+// the content of a new node until it is modified
+static const char zeroPage[PageFile::MAX_PAGE_SIZE] = { 0 };
+
 /*
  * Read the content of the node from the page pid in the PageFile pf.
  * @param pid[IN] the PageId to read
  * @param pf[IN] PageFile to read from
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::read(PageId pid, const PageFile& pf) {
+template <class Key>
+RC BTLeafNode<Key>::read(PageId pid, const PageFile& pf) {
     if (pid < 0 || pid > pf.endPid()) return RC_INVALID_PID;
-//    int tmp =0;
-//    memcpy(buffer, &tmp, sizeof(int));
-//    cout<< getKeyCount()<<"      ";
-    return pf.read(pid, buffer);
+    if (pf.getPageSize() != pageSize) return RC_INVALID_PAGE_SIZE;
+
+    // pin the page and work on it in place in the buffer pool
+    RC rc = pf.pin(pid, guard);
+    if (rc < 0) return rc;
+    page = guard.data();
+    return 0;
 }
 
 /*
@@ -26,20 +33,24 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf) {
  * @param pf[IN] PageFile to write to
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::write(PageId pid, PageFile& pf) {
-    if (pid < 0 || pid > pf.endPid()) return RC_INVALID_PID;
-    return pf.write(pid, buffer);
+template <class Key>
+RC BTLeafNode<Key>::write(PageId pid, PageFile& pf) {
+    // pid may be beyond endPid() in an extent reserved by PageFile::allocate()
+    if (pid < 0) return RC_INVALID_PID;
+    if (pf.getPageSize() != pageSize) return RC_INVALID_PAGE_SIZE;
+    return pf.write(pid, page);
 }
 
 /*
  * Return the number of keys stored in the node.
  * @return the number of keys in the node
  */
-int BTLeafNode::getKeyCount() {
+template <class Key>
+int BTLeafNode<Key>::getKeyCount() {
 
     // the first 4 bytes store the number of keys in the leaf node
     int numKeys;
-    memcpy(&numKeys, buffer, sizeof(numKeys));
+    memcpy(&numKeys, page, sizeof(numKeys));
     return numKeys;
 }
 
@@ -49,20 +60,22 @@ int BTLeafNode::getKeyCount() {
  * @param rid[IN] the RecordId to insert
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTLeafNode::insert(int key, const RecordId& rid) {
+template <class Key>
+RC BTLeafNode<Key>::insert(const Key& key, const RecordId& rid) {
+    own();
 
     int numKeys = getKeyCount();
 
-    int sizeRid = sizeof(RecordId);
-    int sizeKey = sizeof(int);
-    int sizePair = sizeRid + sizeKey;    // 12 bytes per pair
+    const int sizeRid = sizeof(RecordId);
+    const int sizeKey = sizeof(Key);
+    const int sizePair = PAIR_SIZE;      // 12 bytes per pair for int keys
 
     if (numKeys == maxKeys) {
         return RC_NODE_FULL;
     }
 
     int i = 1;
-    int tmpKey;
+    Key tmpKey;
     for (; i <= numKeys; i++) {
         memcpy(&tmpKey, buffer + sizeof(numKeys)+ sizeRid + (i - 1) * sizePair , sizeKey);
         if (key < tmpKey) {
@@ -89,12 +102,15 @@ RC BTLeafNode::insert(int key, const RecordId& rid) {
  * @param siblingKey[OUT] the first key in the sibling node after split.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
-                              BTLeafNode& sibling, int& siblingKey) {
+template <class Key>
+RC BTLeafNode<Key>::insertAndSplit(const Key& key, const RecordId& rid,
+                                   BTLeafNode& sibling, Key& siblingKey) {
+    own();
+    sibling.own();
 
-    int sizeKey = sizeof(key);
-    int sizeRid = sizeof(rid);
-    int sizePair = sizeKey + sizeRid;
+    const int sizeKey = sizeof(Key);
+    const int sizeRid = sizeof(RecordId);
+    const int sizePair = PAIR_SIZE;
 
     int numKeys = getKeyCount();
     if (numKeys < maxKeys) return RC_NO_NEED_SPLIT;
@@ -103,12 +119,13 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
     // split algorithm
     // insert key, and split into two part, the first ceiling(n/2) keys in the left node, the rest in the right node
 
-    // move all pairs into tmpBuffer, the size of tmpBuffer is (numKeys + 1)
-    char tmpBuffer[(numKeys + 1) * sizePair];
+    // move all pairs into tmpBuffer, which has room for (numKeys + 1)
+    // pairs in a node of the largest page size
+    char tmpBuffer[(fanout(PageFile::MAX_PAGE_SIZE) + 1) * PAIR_SIZE];
     memmove(tmpBuffer, buffer + sizeof(numKeys), numKeys * sizePair);
 
     int i=1;
-    int tmpKey;
+    Key tmpKey;
     for (; i <= numKeys; i++) {
         memcpy(&tmpKey, tmpBuffer + (i - 1) * sizePair + sizeRid, sizeKey);
         if (key < tmpKey) break;
@@ -127,7 +144,7 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
 
 
     // move the content of tmpBuffer to buffer and sibling.buffer
-    memset(buffer, 0, sizeof(buffer) - sizeof(PageId));
+    memset(buffer, 0, pageSize - sizeof(PageId));
     memcpy(buffer, &lefthalfNumKeys, sizeof(lefthalfNumKeys));
     memmove(buffer + sizeof(lefthalfNumKeys), tmpBuffer, lefthalfNumKeys * sizePair);
 
@@ -152,20 +169,20 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
                    behind the largest key smaller than searchKey.
  * @return 0 if searchKey is found. Otherwise return an error code.
  */
-RC BTLeafNode::locate(int searchKey, int& eid) {
+template <class Key>
+RC BTLeafNode<Key>::locate(const Key& searchKey, int& eid) {
 
     int numKeys = getKeyCount();
     // what if numKeys == 0 ?
     // before call this method, node cannot be empty
 
-    int sizeRid = sizeof(RecordId);
-    int sizeKey = sizeof(int);
-    int sizePair = sizeRid + sizeKey;
+    const int sizeRid = sizeof(RecordId);
+    const int sizePair = PAIR_SIZE;
 
     int i = 1;
-    int tmpKey;
+    Key tmpKey;
     for (; i <= numKeys; i++) {
-        memcpy(&tmpKey, buffer + sizeof(numKeys) + (i - 1) * sizePair + sizeRid, sizeof(tmpKey));
+        memcpy(&tmpKey, page + sizeof(numKeys) + (i - 1) * sizePair + sizeRid, sizeof(tmpKey));
         if (searchKey == tmpKey) {
             eid = i;
             return 0;
@@ -176,7 +193,10 @@ RC BTLeafNode::locate(int searchKey, int& eid) {
         }
     }
 
-    return 0;
+    // searchKey is larger than all keys in the node (or the node is
+    // empty after deletions): the entry after the last one
+    eid = numKeys + 1;
+    return RC_NO_SUCH_RECORD;
 }
 
 /*
@@ -186,17 +206,42 @@ RC BTLeafNode::locate(int searchKey, int& eid) {
  * @param rid[OUT] the RecordId from the entry
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid) {
+template <class Key>
+RC BTLeafNode<Key>::readEntry(int eid, Key& key, RecordId& rid) {
 
-    int sizeRid = sizeof(RecordId);    // 8 bytes
-    int sizeKey = sizeof(int);         // 4 bytes
-    int sizePair = sizeRid + sizeKey;  // 8 + 4 = 12 bytes per pair
+    const int sizeRid = sizeof(RecordId);    // 8 bytes
+    const int sizeKey = sizeof(Key);         // 4 bytes for int keys
+    const int sizePair = PAIR_SIZE;          // 8 + 4 = 12 bytes per pair
 
     int numKeys = getKeyCount();
     if (eid < 1 || eid > numKeys) return RC_INVALID_EID;
 
-    memcpy(&rid, buffer + sizeof(numKeys) + (eid - 1) * sizePair, sizeRid);
-    memcpy(&key, buffer + sizeof(numKeys) + (eid - 1) * sizePair + sizeRid, sizeKey);
+    memcpy(&rid, page + sizeof(numKeys) + (eid - 1) * sizePair, sizeRid);
+    memcpy(&key, page + sizeof(numKeys) + (eid - 1) * sizePair + sizeRid, sizeKey);
+
+    return 0;
+}
+
+/*
+ * Remove the eid entry from the node.
+ * @param eid[IN] the entry number to remove
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+template <class Key>
+RC BTLeafNode<Key>::remove(int eid) {
+    own();
+
+    const int sizePair = PAIR_SIZE;
+
+    int numKeys = getKeyCount();
+    if (eid < 1 || eid > numKeys) return RC_INVALID_EID;
+
+    // shift the entries after eid to the left
+    memmove(buffer + sizeof(numKeys) + (eid - 1) * sizePair, buffer + sizeof(numKeys) + eid * sizePair, (numKeys - eid) * sizePair);
+    memset(buffer + sizeof(numKeys) + (numKeys - 1) * sizePair, 0, sizePair);
+
+    numKeys--;
+    memcpy(buffer, &numKeys, sizeof(numKeys));
 
     return 0;
 }
@@ -205,9 +250,10 @@ RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid) {
  * Return the pid of the next slibling node.
  * @return the PageId of the next sibling node
  */
-PageId BTLeafNode::getNextNodePtr() {
+template <class Key>
+PageId BTLeafNode<Key>::getNextNodePtr() {
     PageId pid = 0;
-    memcpy(&pid, buffer + PageFile::PAGE_SIZE - sizeof(pid), sizeof(pid));
+    memcpy(&pid, page + pageSize - sizeof(pid), sizeof(pid));
     return pid;
 }
 
@@ -216,28 +262,55 @@ PageId BTLeafNode::getNextNodePtr() {
  * @param pid[IN] the PageId of the next sibling node
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::setNextNodePtr(PageId pid) {
+template <class Key>
+RC BTLeafNode<Key>::setNextNodePtr(PageId pid) {
+    own();
 
     // the last 4 bytes store the next node pointer
     if (pid < 0 ) return RC_INVALID_PID;
-    memcpy(buffer + PageFile::PAGE_SIZE - sizeof(pid), &pid, sizeof(pid));
+    memcpy(buffer + pageSize - sizeof(pid), &pid, sizeof(pid));
     return 0;
 }
 
-BTLeafNode::BTLeafNode(){
-    maxKeys=80;
-    memset(buffer,0,sizeof(buffer) );
+template <class Key>
+BTLeafNode<Key>::BTLeafNode(int pageSize){
+    static_assert(fanout(PageFile::PAGE_SIZE) >= 3, "the key is too large for a leaf");
+
+    // (key, rid) pairs between the key count and the next node pointer,
+    // keeping 4 pairs free. 80 for int keys and 1KB pages
+    this->pageSize = pageSize;
+    maxKeys = fanout(pageSize);
+    buffer = NULL;
+    page = zeroPage;
+}
+
+template <class Key>
+BTLeafNode<Key>::~BTLeafNode(){
+    delete [] buffer;
+}
+
+/*
+ * Make a private copy of the page before it is modified.
+ */
+template <class Key>
+void BTLeafNode<Key>::own() {
+    if (page == buffer) return;
+    if (buffer == NULL) buffer = new char[pageSize];
+    memcpy(buffer, page, pageSize);
+    page = buffer;
+    guard.release();
 }
 
-void BTLeafNode::print() {
+template <class Key>
+void BTLeafNode<Key>::print() {
 
-    int pairSize = sizeof(RecordId) + sizeof(int);
-    char *temp = buffer;
-    temp=temp+12;
+    int pairSize = PAIR_SIZE;
+    const char *temp = page;
+    temp=temp+sizeof(int)+sizeof(RecordId);
     cout << "--------leaf node---------" << endl;
     for (int i = 0; i < getKeyCount() * pairSize; i += pairSize) {
-        int insideKey;
-        memcpy(&insideKey, temp, sizeof(int));
+        Key insideKey;
+        memcpy(&insideKey, temp, sizeof(Key));
 
         cout << insideKey << " ";
 
@@ -251,9 +324,33 @@ void BTLeafNode::print() {
 
 
 
-BTNonLeafNode::BTNonLeafNode(){
-    maxKeys=125;
-    memset(buffer,0,sizeof(buffer) );
+template <class Key>
+BTNonLeafNode<Key>::BTNonLeafNode(int pageSize){
+    static_assert(fanout(PageFile::PAGE_SIZE) >= 3, "the key is too large for a non-leaf node");
+
+    // (key, pid) pairs behind the key count and the first pid, keeping
+    // 2 pairs free. 125 for int keys and 1KB pages
+    this->pageSize = pageSize;
+    maxKeys = fanout(pageSize);
+    buffer = NULL;
+    page = zeroPage;
+}
+
+template <class Key>
+BTNonLeafNode<Key>::~BTNonLeafNode(){
+    delete [] buffer;
+}
+
+/*
+ * Make a private copy of the page before it is modified.
+ */
+template <class Key>
+void BTNonLeafNode<Key>::own() {
+    if (page == buffer) return;
+    if (buffer == NULL) buffer = new char[pageSize];
+    memcpy(buffer, page, pageSize);
+    page = buffer;
+    guard.release();
 }
 
 
@@ -263,9 +360,16 @@ BTNonLeafNode::BTNonLeafNode(){
  * @param pf[IN] PageFile to read from
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::read(PageId pid, const PageFile& pf) {
+template <class Key>
+RC BTNonLeafNode<Key>::read(PageId pid, const PageFile& pf) {
     if (pid < 0 || pid > pf.endPid()) return RC_INVALID_PID;
-    return pf.read(pid, buffer);
+    if (pf.getPageSize() != pageSize) return RC_INVALID_PAGE_SIZE;
+
+    // pin the page and work on it in place in the buffer pool
+    RC rc = pf.pin(pid, guard);
+    if (rc < 0) return rc;
+    page = guard.data();
+    return 0;
 }
 
 /*
@@ -274,49 +378,84 @@ RC BTNonLeafNode::read(PageId pid, const PageFile& pf) {
  * @param pf[IN] PageFile to write to
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::write(PageId pid, PageFile& pf) {
-    if (pid < 0 || pid > pf.endPid()) return RC_INVALID_PID;
-    return pf.write(pid, buffer);
+template <class Key>
+RC BTNonLeafNode<Key>::write(PageId pid, PageFile& pf) {
+    // pid may be beyond endPid() in an extent reserved by PageFile::allocate()
+    if (pid < 0) return RC_INVALID_PID;
+    if (pf.getPageSize() != pageSize) return RC_INVALID_PAGE_SIZE;
+    return pf.write(pid, page);
 }
 
 /*
  * Return the number of keys stored in the node.
  * @return the number of keys in the node
  */
-int BTNonLeafNode::getKeyCount() {
+template <class Key>
+int BTNonLeafNode<Key>::getKeyCount() {
     // the first 4 bytes store the number of keys in the non-leaf node
     int numKeys;
-    memcpy(&numKeys, buffer, sizeof(numKeys));
+    memcpy(&numKeys, page, sizeof(numKeys));
     return numKeys;
 }
 
 
+/*
+ * Find the slot of a new (key, pid) pair in a non-leaf node: right behind
+ * the child that pid was split off from, if it is known. Otherwise before
+ * the first greater key.
+ * @param pairs[IN] the (key, pid) pairs of the node, after the first pid
+ * @param first[IN] the first pid of the node
+ * @param numKeys[IN] the number of pairs
+ * @param key[IN] the key to insert
+ * @param left[IN] the child that pid was split off from, or -1
+ * @return the slot of the pair, from 1 to numKeys + 1
+ */
+template <class Key>
+static int insertSlot(const char* pairs, PageId first, int numKeys, const Key& key, PageId left) {
+    const int sizePair = BTNonLeafNode<Key>::PAIR_SIZE;
+
+    if (left != -1) {
+        if (left == first) return 1;
+        for (int i = 1; i <= numKeys; i++) {
+            PageId tmpPid;
+            memcpy(&tmpPid, pairs + (i - 1) * sizePair + sizeof(Key), sizeof(PageId));
+            if (tmpPid == left) return i + 1;
+        }
+    }
+
+    int i = 1;
+    Key tmpKey;
+    for (; i <= numKeys; i++) {
+        memcpy(&tmpKey, pairs + (i - 1) * sizePair, sizeof(Key));
+        if (key < tmpKey) break;
+    }
+    return i;
+}
+
 /*
  * Insert a (key, pid) pair to the node.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
+ * @param left[IN] the child that pid was split off from, or -1
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTNonLeafNode::insert(int key, PageId pid) {
+template <class Key>
+RC BTNonLeafNode<Key>::insert(const Key& key, PageId pid, PageId left) {
+    own();
 
     int numKeys = getKeyCount();
 
-    int sizePageId = sizeof(PageId);
-    int sizeKey = sizeof(key);
-    int sizePair = sizePageId + sizeKey;
+    const int sizePageId = sizeof(PageId);
+    const int sizeKey = sizeof(Key);
+    const int sizePair = PAIR_SIZE;
 
     if (numKeys == maxKeys) {
         return RC_NODE_FULL;
     }
 
-    int i = 1;
-    int tmpKey;
-    for (; i <= numKeys; i++) {
-        memcpy(&tmpKey, buffer + sizeof(numKeys) + sizePageId + (i - 1) * sizePair , sizeKey);
-        if (key < tmpKey) {
-            break;
-        }
-    }
+    PageId first;
+    memcpy(&first, buffer + sizeof(numKeys), sizePageId);
+    int i = insertSlot(buffer + sizeof(numKeys) + sizePageId, first, numKeys, key, left);
 
     memmove(buffer + sizeof(numKeys) + sizePageId + i * sizePair, buffer + sizeof(numKeys) + sizePageId + (i - 1) * sizePair, (numKeys - i + 1) * sizePair);
     memcpy(buffer + sizeof(numKeys) + sizePageId + (i - 1) * sizePair, &key, sizeKey);
@@ -336,26 +475,28 @@ RC BTNonLeafNode::insert(int key, PageId pid) {
  * @param pid[IN] the PageId to insert
  * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
  * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+ * @param left[IN] the child that pid was split off from, or -1
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey) {
+template <class Key>
+RC BTNonLeafNode<Key>::insertAndSplit(const Key& key, PageId pid, BTNonLeafNode& sibling, Key& midKey, PageId left) {
+    own();
+    sibling.own();
 
     int numKeys = getKeyCount();
     if (numKeys < maxKeys) return RC_NO_NEED_SPLIT;
 
-    int sizeKey = sizeof(key);
-    int sizePageId = sizeof(pid);
-    int sizePair = sizeKey + sizePageId;
+    const int sizeKey = sizeof(Key);
+    const int sizePageId = sizeof(PageId);
+    const int sizePair = PAIR_SIZE;
 
-    char tmpBuffer[(maxKeys + 1) * sizePair];
+    // room for (maxKeys + 1) pairs in a node of the largest page size
+    char tmpBuffer[(fanout(PageFile::MAX_PAGE_SIZE) + 1) * PAIR_SIZE];
     memcpy(tmpBuffer, buffer + sizeof(numKeys) + sizePageId, maxKeys * sizePair);
 
-    int i = 1;
-    int tmpKey;
-    for (; i <= numKeys; i++) {
-        memcpy(&tmpKey, tmpBuffer + (i - 1) * sizePair, sizeKey);
-        if (key < tmpKey) break;
-    }
+    PageId first;
+    memcpy(&first, buffer + sizeof(numKeys), sizePageId);
+    int i = insertSlot(tmpBuffer, first, numKeys, key, left);
 
     memmove(tmpBuffer + i * sizePair, tmpBuffer + (i - 1) * sizePair, (numKeys - i + 1) * sizePair);
     memcpy(tmpBuffer + (i - 1) * sizePair, &key, sizeKey);
@@ -371,7 +512,7 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
     memcpy(buffer, &lefthalfNumKeys, sizeof(lefthalfNumKeys));
     memmove(buffer + sizeof(lefthalfNumKeys) + sizePageId, tmpBuffer, lefthalfNumKeys * sizePair);
     memcpy(sibling.buffer, &righthalfNumKeys, sizeof(righthalfNumKeys));
-    memmove(sibling.buffer + sizeof(righthalfNumKeys), tmpBuffer + lefthalfNumKeys * sizePair+ sizeof(int) , righthalfNumKeys * sizePair+sizeof(int) );
+    memmove(sibling.buffer + sizeof(righthalfNumKeys), tmpBuffer + lefthalfNumKeys * sizePair+ sizeKey , righthalfNumKeys * sizePair+sizeKey );
 
 
     memcpy(&midKey, tmpBuffer +  lefthalfNumKeys * sizePair, sizeKey);
@@ -391,26 +532,30 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
  * @param pid[OUT] the pointer to the child node to follow.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid) {
+template <class Key>
+RC BTNonLeafNode<Key>::locateChildPtr(const Key& searchKey, PageId& pid) {
 
-    int sizePageId = sizeof(PageId);
-    int sizeKey = sizeof(searchKey);
-    int sizePair = sizePageId + sizeKey;
+    const int sizePageId = sizeof(PageId);
+    const int sizeKey = sizeof(Key);
+    const int sizePair = PAIR_SIZE;
 
     int numKeys = getKeyCount();
     if (numKeys < 1) return RC_LOCATECHILD_FAILED;
 
     int i;
-    int tmpKey;
+    Key tmpKey;
     for (i = 1; i <= numKeys; i++) {
-        memcpy(&tmpKey, buffer + sizeof(numKeys) + (i - 1) * sizePair + sizePageId, sizeKey);
-        if (searchKey < tmpKey) {
-            memcpy(&pid, buffer + sizeof(numKeys) + (i - 1) * sizePair, sizePageId);
+        memcpy(&tmpKey, page + sizeof(numKeys) + (i - 1) * sizePair + sizePageId, sizeKey);
+        // a key equal to the separator may also end the left child, when
+        // the entries of a duplicate key span two nodes. go left, so that
+        // the search finds the first of them
+        if (searchKey <= tmpKey) {
+            memcpy(&pid, page + sizeof(numKeys) + (i - 1) * sizePair, sizePageId);
             return 0;
         }
         // the last pointer
         if (i == numKeys) {
-            memcpy(&pid, buffer + sizeof(numKeys) + i * sizePair, sizePageId);
+            memcpy(&pid, page + sizeof(numKeys) + i * sizePair, sizePageId);
             return 0;
         }
     }
@@ -425,7 +570,9 @@ RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid) {
  * @param pid2[IN] the PageId to insert behind the key
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2) {
+template <class Key>
+RC BTNonLeafNode<Key>::initializeRoot(PageId pid1, const Key& key, PageId pid2) {
+    own();
 
     int numKeys = getKeyCount();
     if (numKeys != 0) return RC_ROOT_INITIAL_FAILED;
@@ -436,25 +583,26 @@ RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2) {
     memcpy(buffer, &numKeys, sizeof(numKeys));
     memcpy(buffer + sizeof(numKeys), &pid1, sizeof(pid1));
     memcpy(buffer + sizeof(numKeys) + sizeof(pid1), &key, sizeof(key));
-    memcpy(buffer + sizeof(numKeys) + sizeof(pid1) + sizeof(key), &pid2, sizeof(pid2));
+    memcpy(buffer + sizeof(numKeys) + sizeof(pid1) + sizeof(Key), &pid2, sizeof(pid2));
 
     return 0;
 }
 
-void BTNonLeafNode::print()
+template <class Key>
+void BTNonLeafNode<Key>::print()
 {
     //This is the size in bytes of an entry pair
-    int pairSize = sizeof(PageId) + sizeof(int);
+    int pairSize = PAIR_SIZE;
 
     //Skip the first 8 offset bytes, since there's no key there
-    char* temp = buffer+8;
+    const char* temp = page+8;
 
     cout << "-----------nonleaf node------------------" << endl;
 
     for(int i=8; i<getKeyCount()*pairSize+8; i+=pairSize)
     {
-        int insideKey;
-        memcpy(&insideKey, temp, sizeof(int)); //Save the current key inside buffer as insideKey
+        Key insideKey;
+        memcpy(&insideKey, temp, sizeof(Key)); //Save the current key inside buffer as insideKey
 
         cout << insideKey << " ";
 
@@ -463,4 +611,19 @@ void BTNonLeafNode::print()
     }
 
     cout <<endl<< "------------------------" << endl;
-}
\ No newline at end of file
+}
+
+
+// =============================================================================
+
+// the fanout of the nodes of int keys is as before
+static_assert(BTLeafNode<int>::fanout(PageFile::PAGE_SIZE) == 80, "leaf fanout changed");
+static_assert(BTNonLeafNode<int>::fanout(PageFile::PAGE_SIZE) == 125, "non-leaf fanout changed");
+
+template class BTLeafNode<int>;
+template class BTLeafNode<long long>;
+template class BTLeafNode<FixedKey<16> >;
+
+template class BTNonLeafNode<int>;
+template class BTNonLeafNode<long long>;
+template class BTNonLeafNode<FixedKey<16> >;
@@ -10,15 +10,75 @@
 #ifndef BTREENODE_H
 #define BTREENODE_H
 
+#include <cstring>
+#include <ostream>
+#include <string>
 #include "RecordFile.h"
 #include "PageFile.h"
+#include "BufferPool.h"
+
+/*
+ * The B+tree classes are templates over the key type. A key is copied
+ * in and out of the pages with memcpy, and compared with <, <=, == and >.
+ * The classes are instantiated in BTreeNode.cc and BTreeIndex.cc for
+ * int, long long and FixedKey<16> keys.
+ */
+
+/**
+ * FixedKey: a string key of N bytes. Shorter strings are padded with
+ * zero bytes, and keys are ordered byte by byte.
+ */
+template <int N>
+struct FixedKey {
+    char bytes[N];
+
+    FixedKey() { memset(bytes, 0, N); }
+
+    /**
+     * Make the key of a string. Only the first N bytes of s are kept.
+     * @param s[IN] the string of the key
+     */
+    explicit FixedKey(const std::string& s) {
+        memset(bytes, 0, N);
+        memcpy(bytes, s.data(), s.size() < (size_t)N ? s.size() : N);
+    }
+
+    bool operator<(const FixedKey& k) const { return memcmp(bytes, k.bytes, N) < 0; }
+    bool operator>(const FixedKey& k) const { return memcmp(bytes, k.bytes, N) > 0; }
+    bool operator<=(const FixedKey& k) const { return memcmp(bytes, k.bytes, N) <= 0; }
+    bool operator==(const FixedKey& k) const { return memcmp(bytes, k.bytes, N) == 0; }
+};
+
+template <int N>
+std::ostream& operator<<(std::ostream& os, const FixedKey<N>& k)
+{
+    return os << std::string(k.bytes, strnlen(k.bytes, N));
+}
 
 
 /**
  * BTLeafNode: The class representing a B+tree leaf node.
  */
+template <class Key>
 class BTLeafNode {
 public:
+    /**
+     * The size of a (rid, key) pair in the node.
+     */
+    static constexpr int PAIR_SIZE = sizeof(RecordId) + sizeof(Key);
+
+    /**
+     * Return the most keys a leaf of the given page size holds.
+     * pageSize - sizeof(numKeys) - sizeof(nextNodePid) = 1016 bytes for 1KB;
+     * 1016 / 12 = 84 ... 8 for int keys.
+     * at most 84 pairs, minus 4 pairs of slack
+     * @param pageSize[IN] the page size of the PageFile of the node
+     * @return the fanout of the node. 80 for int keys and 1KB pages
+     */
+    static constexpr int fanout(int pageSize) {
+        return (pageSize - (int)(sizeof(int) + sizeof(PageId))) / PAIR_SIZE - 4;
+    }
+
     /**
      * Insert the (key, rid) pair to the node.
      * Remember that all keys inside a B+tree node should be kept sorted.
@@ -26,7 +86,7 @@ public:
      * @param rid[IN] the RecordId to insert
      * @return 0 if successful. Return an error code if the node is full.
      */
-    RC insert(int key, const RecordId& rid);
+    RC insert(const Key& key, const RecordId& rid);
 
     /**
      * Insert the (key, rid) pair to the node
@@ -39,7 +99,7 @@ public:
      * @param siblingKey[OUT] the first key in the sibling node after split.
      * @return 0 if successful. Return an error code if there is an error.
      */
-    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
+    RC insertAndSplit(const Key& key, const RecordId& rid, BTLeafNode& sibling, Key& siblingKey);
 
     /**
      * If searchKey exists in the node, set eid to the index entry
@@ -52,7 +112,7 @@ public:
                        behind the largest key smaller than searchKey.
      * @return 0 if searchKey is found. If not, RC_NO_SEARCH_RECORD.
      */
-    RC locate(int searchKey, int& eid);
+    RC locate(const Key& searchKey, int& eid);
 
     /**
      * Read the (key, rid) pair from the eid entry.
@@ -61,7 +121,15 @@ public:
      * @param rid[OUT] the RecordId from the slot
      * @return 0 if successful. Return an error code if there is an error.
      */
-    RC readEntry(int eid, int& key, RecordId& rid);
+    RC readEntry(int eid, Key& key, RecordId& rid);
+
+    /**
+     * Remove the eid entry from the node. The node is not merged with
+     * its siblings even if it becomes empty.
+     * @param eid[IN] the entry number to remove
+     * @return 0 if successful. Return an error code if there is an error.
+     */
+    RC remove(int eid);
 
     /**
      * Return the pid of the next slibling node.
@@ -100,36 +168,76 @@ public:
     RC write(PageId pid, PageFile& pf);
 
     void print();
-    BTLeafNode();
+
+    /**
+     * Create an empty node for a PageFile with the given page size.
+     * @param pageSize[IN] the page size of the PageFile of the node
+     */
+    BTLeafNode(int pageSize = PageFile::PAGE_SIZE);
+    ~BTLeafNode();
 
 public:
 
-    // 1024 - sizeof(numKeys) - sizeof(nextNodePid) = 1016 bytes;
-    // 1016 / 12 = 84 ... 8
-    // at most 84 pairs
+    int maxKeys;   // fanout(pageSize). 80 for int keys and 1KB pages
+    int pageSize;  // the page size of the node
+    /**
+     * The content of the node. After read(), it points to the page
+     * pinned in the buffer pool. Before the first modification, the
+     * page is copied to buffer, and it points to buffer.
+     */
+    const char* page;
 
-    int maxKeys;   //84
     /**
-     * The main memory buffer for loading the content of the disk page
-     * that contains the node.
+     * The private copy of the page that is modified by insert() etc.
+     * NULL until the node is modified.
      */
-    char buffer[PageFile::PAGE_SIZE];
+    char* buffer;
+
+private:
+    PageGuard guard;  // the pin on the page read by read()
+
+    // make a private copy of the page before it is modified
+    void own();
+
+    BTLeafNode(const BTLeafNode&);
+    BTLeafNode& operator=(const BTLeafNode&);
 };
 
 
 /**
  * BTNonLeafNode: The class representing a B+tree nonleaf node.
  */
+template <class Key>
 class BTNonLeafNode {
 public:
+    /**
+     * The size of a (key, pid) pair in the node.
+     */
+    static constexpr int PAIR_SIZE = sizeof(Key) + sizeof(PageId);
+
+    /**
+     * Return the most keys a non-leaf node of the given page size holds.
+     * pageSize - sizeof(numKeys) - sizeof(PageId) = 1016 for 1KB;
+     * 1016 / (sizeof(key) + sizeof(PageId)) = 127 for int keys,
+     * minus 2 keys of slack
+     * @param pageSize[IN] the page size of the PageFile of the node
+     * @return the fanout of the node. 125 for int keys and 1KB pages
+     */
+    static constexpr int fanout(int pageSize) {
+        return (pageSize - (int)(sizeof(int) + sizeof(PageId))) / PAIR_SIZE - 2;
+    }
+
     /**
      * Insert a (key, pid) pair to the node.
      * Remember that all keys inside a B+tree node should be kept sorted.
      * @param key[IN] the key to insert
      * @param pid[IN] the PageId to insert
+     * @param left[IN] the child that pid was split off from. the pair
+     *                 goes right behind it, which the key alone does not
+     *                 tell when other keys are equal to it. -1 if unknown
      * @return 0 if successful. Return an error code if the node is full.
      */
-    RC insert(int key, PageId pid);
+    RC insert(const Key& key, PageId pid, PageId left = -1);
 
     /**
      * Insert the (key, pid) pair to the node
@@ -141,9 +249,10 @@ public:
      * @param pid[IN] the PageId to insert
      * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
      * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+     * @param left[IN] the child that pid was split off from (see insert())
      * @return 0 if successful. Return an error code if there is an error.
      */
-    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
+    RC insertAndSplit(const Key& key, PageId pid, BTNonLeafNode& sibling, Key& midKey, PageId left = -1);
 
     /**
      * Given the searchKey, find the child-node pointer to follow and
@@ -153,7 +262,7 @@ public:
      * @param pid[OUT] the pointer to the child node to follow.
      * @return 0 if successful. Return an error code if there is an error.
      */
-    RC locateChildPtr(int searchKey, PageId& pid);
+    RC locateChildPtr(const Key& searchKey, PageId& pid);
 
     /**
      * Initialize the root node with (pid1, key, pid2).
@@ -162,7 +271,7 @@ public:
      * @param pid2[IN] the PageId to insert behind the key
      * @return 0 if successful. Return an error code if there is an error.
      */
-    RC initializeRoot(PageId pid1, int key, PageId pid2);
+    RC initializeRoot(PageId pid1, const Key& key, PageId pid2);
 
     /**
      * Return the number of keys stored in the node.
@@ -186,22 +295,40 @@ public:
      */
     RC write(PageId pid, PageFile& pf);
 
-    BTNonLeafNode();
+    /**
+     * Create an empty node for a PageFile with the given page size.
+     * @param pageSize[IN] the page size of the PageFile of the node
+     */
+    BTNonLeafNode(int pageSize = PageFile::PAGE_SIZE);
+    ~BTNonLeafNode();
 
     void print();
 
 public:
-    // 1024 - sizeof(numKeys) - sizeof(PageId) = 1016;
-    // 1016 / (sizeof(key) + sizeof(PageId)) = 127
+    int maxKeys;  // fanout(pageSize). 125 for int keys and 1KB pages
+    int pageSize; // the page size of the node
 
-    int maxKeys;  //127
+    /**
+     * The content of the node. After read(), it points to the page
+     * pinned in the buffer pool. Before the first modification, the
+     * page is copied to buffer, and it points to buffer.
+     */
+    const char* page;
 
     /**
-     * The main memory buffer for loading the content of the disk page
-     * that contains the node.
+     * The private copy of the page that is modified by insert() etc.
+     * NULL until the node is modified.
      */
-    char buffer[PageFile::PAGE_SIZE];
+    char* buffer;
+
+private:
+    PageGuard guard;  // the pin on the page read by read()
+
+    // make a private copy of the page before it is modified
+    void own();
 
+    BTNonLeafNode(const BTNonLeafNode&);
+    BTNonLeafNode& operator=(const BTNonLeafNode&);
 };
 
 #endif /* BTREENODE_H */
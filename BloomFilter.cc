@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <bitset>
+#include <climits>
+#include <cmath>
+#include "BloomFilter.h"
+
+BloomFilter::BloomFilter()
+{
+  bits = 0;
+}
+
+void BloomFilter::reset(long long entries)
+{
+  // the bits are kept in whole 64-bit words
+  bits = (unsigned long long)(entries > 0 ? entries : 1) * BITS_PER_ENTRY;
+  bits = (bits + 63) / 64 * 64;
+  words.assign(bits / 64, 0);
+}
+
+unsigned long long BloomFilter::hash(const void* data, int length)
+{
+  // FNV-1a, with the bits mixed at the end so that the low and the
+  // high halves are independent enough for double hashing
+  const unsigned char* p = (const unsigned char*)data;
+  unsigned long long h = 14695981039346656037ULL;
+  for (int i = 0; i < length; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+void BloomFilter::add(unsigned long long h)
+{
+  if (bits == 0) return;
+
+  // the i'th bit of the entry is h1 + i * h2
+  unsigned long long h1 = h & 0xFFFFFFFF;
+  unsigned long long h2 = (h >> 32) | 1;
+  for (int i = 0; i < HASH_COUNT; i++) {
+    unsigned long long bit = (h1 + i * h2) % bits;
+    words[bit / 64] |= 1ULL << (bit % 64);
+  }
+}
+
+bool BloomFilter::mayContain(unsigned long long h) const
+{
+  // an empty filter rules nothing out
+  if (bits == 0) return true;
+
+  unsigned long long h1 = h & 0xFFFFFFFF;
+  unsigned long long h2 = (h >> 32) | 1;
+  for (int i = 0; i < HASH_COUNT; i++) {
+    unsigned long long bit = (h1 + i * h2) % bits;
+    if (!(words[bit / 64] & (1ULL << (bit % 64)))) return false;
+  }
+  return true;
+}
+
+long long BloomFilter::estimateEntries() const
+{
+  if (bits == 0) return 0;
+
+  unsigned long long set = 0;
+  for (size_t i = 0; i < words.size(); i++) set += std::bitset<64>(words[i]).count();
+  if (set >= bits) return LLONG_MAX;
+
+  // n entries leave a bit clear with probability (1 - 1/bits)^(n * k),
+  // so n = -bits / k * ln(1 - set / bits)
+  return (long long)(-(double)bits / HASH_COUNT * std::log(1.0 - (double)set / bits));
+}
+
+RC BloomFilter::write(FILE* fp) const
+{
+  // the # bits, then the words
+  if (fwrite(&bits, sizeof(bits), 1, fp) != 1) return RC_FILE_WRITE_FAILED;
+  if (!words.empty() && fwrite(&words[0], sizeof(words[0]), words.size(), fp) != words.size()) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  return 0;
+}
+
+RC BloomFilter::read(FILE* fp)
+{
+  unsigned long long n;
+
+  if (fread(&n, sizeof(n), 1, fp) != 1 || n % 64 != 0) return RC_FILE_READ_FAILED;
+
+  // a damaged size must not make us allocate more than the file holds
+  long pos = ftell(fp);
+  if (pos < 0 || fseek(fp, 0, SEEK_END) < 0) return RC_FILE_READ_FAILED;
+  long end = ftell(fp);
+  if (end < 0 || (unsigned long long)(end - pos) < n / 8 ||
+      fseek(fp, pos, SEEK_SET) < 0) {
+    return RC_FILE_READ_FAILED;
+  }
+
+  words.assign(n / 64, 0);
+  if (!words.empty() && fread(&words[0], sizeof(words[0]), words.size(), fp) != words.size()) {
+    words.clear();
+    bits = 0;
+    return RC_FILE_READ_FAILED;
+  }
+  bits = n;
+  return 0;
+}
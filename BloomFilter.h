@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <cstdio>
+#include <vector>
+#include "Bruinbase.h"
+
+/**
+ * A Bloom filter: a set of hashes that answers "may contain" with no
+ * false negatives and about 1% false positives when it holds at most
+ * the number of entries it was sized for. An entry sets HASH_COUNT bits
+ * of the filter, derived from one 64-bit hash of the entry by double
+ * hashing. Entries cannot be removed; a filter that holds more entries
+ * than it was sized for only gives more false positives.
+ */
+class BloomFilter {
+ public:
+  static const int BITS_PER_ENTRY = 10;  // # bits of the filter per entry
+  static const int HASH_COUNT = 7;       // # bits an entry sets
+
+  BloomFilter();
+
+  /**
+   * size the filter for a number of entries and empty it.
+   * @param entries[IN] the # entries the filter is meant to hold
+   */
+  void reset(long long entries);
+
+  /**
+   * compute the hash of an entry.
+   * @param data[IN] the bytes of the entry
+   * @param length[IN] # bytes of the entry
+   * @return the 64-bit hash
+   */
+  static unsigned long long hash(const void* data, int length);
+
+  /**
+   * add an entry to the filter.
+   * @param h[IN] the hash of the entry
+   */
+  void add(unsigned long long h);
+
+  /**
+   * @param h[IN] the hash of an entry
+   * @return false if the entry was never added to the filter
+   */
+  bool mayContain(unsigned long long h) const;
+
+  /**
+   * @return the # entries the filter was sized for
+   */
+  long long getCapacity() const { return bits / BITS_PER_ENTRY; }
+
+  /**
+   * estimate the # distinct entries added to the filter from the
+   * fraction of its bits that are set.
+   * @return the estimated # entries
+   */
+  long long estimateEntries() const;
+
+  /**
+   * write the filter to a file.
+   * @param fp[IN] the file, open for writing
+   * @return error code. 0 if no error
+   */
+  RC write(FILE* fp) const;
+
+  /**
+   * read a filter written by write().
+   * @param fp[IN] the file, open for reading
+   * @return error code. 0 if no error
+   */
+  RC read(FILE* fp);
+
+ private:
+  std::vector<unsigned long long> words;  // the bits of the filter
+  unsigned long long bits;                // # bits of the filter
+};
+
+#endif // BLOOMFILTER_H
@@ -30,5 +30,8 @@ const int RC_INVALID_EID         = -1015;
 const int RC_NO_NEED_SPLIT       = -1016;
 const int RC_LOCATECHILD_FAILED  = -1017;
 const int RC_ROOT_INITIAL_FAILED = -1018;
+const int RC_END_OF_BATCH        = -1019;
+const int RC_INVALID_PAGE_SIZE   = -1020;
+const int RC_END_OF_SCAN         = -1021;
 
 #endif // BRUINBASE_H
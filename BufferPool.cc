@@ -0,0 +1,866 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "Bruinbase.h"
+#include "BufferPool.h"
+#include <cstring>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include <sys/mman.h>
+
+//
+// the interface of a page replacement policy. the frames of a shard are
+// linked into the lists of its policy through Frame::prev and Frame::next
+//
+class BufferPool::Replacer {
+ public:
+  virtual ~Replacer() {}
+
+  // a page was brought into the shard
+  virtual void admit(Frame* f) = 0;
+
+  // a cached page was used again
+  virtual void touch(Frame* f) = 0;
+
+  // a page leaves the shard. evicted is true if the page was chosen by
+  // victim(), and false if it was dropped (e.g., invalidated)
+  virtual void remove(Frame* f, bool evicted) = 0;
+
+  // the page to evict next. a pinned page is never chosen.
+  // NULL if there is no page to evict
+  virtual Frame* victim() = 0;
+
+  // the frames from the next victim to the most valuable page
+  virtual void frames(std::vector<Frame*>& list) = 0;
+
+ protected:
+  // a circular doubly linked list of frames with a sentinel
+  struct FrameList {
+    Frame head;
+    size_t bytes;     // total size of the pages in the list
+
+    FrameList() : bytes(0) { head.prev = head.next = &head; }
+
+    bool empty() const { return head.next == &head; }
+
+    // the oldest frame that is not pinned. NULL if there is none
+    Frame* last()
+    {
+      for (Frame* f = head.prev; f != &head; f = f->prev) {
+        if (f->pins == 0) return f;
+      }
+      return NULL;
+    }
+
+    void pushFront(Frame* f)
+    {
+      f->prev = &head;
+      f->next = head.next;
+      head.next->prev = f;
+      head.next = f;
+      bytes += f->size;
+    }
+
+    void unlink(Frame* f)
+    {
+      f->prev->next = f->next;
+      f->next->prev = f->prev;
+      bytes -= f->size;
+    }
+
+    void append(std::vector<Frame*>& list)
+    {
+      for (Frame* f = head.prev; f != &head; f = f->prev) list.push_back(f);
+    }
+  };
+};
+
+//
+// evict the least recently used page
+//
+class BufferPool::LruReplacer : public BufferPool::Replacer {
+ public:
+  void admit(Frame* f) { lru.pushFront(f); }
+  void touch(Frame* f) { lru.unlink(f); lru.pushFront(f); }
+  void remove(Frame* f, bool) { lru.unlink(f); }
+  Frame* victim() { return lru.last(); }
+  void frames(std::vector<Frame*>& list) { lru.append(list); }
+
+ private:
+  FrameList lru;   // the head is the most recently used page
+};
+
+//
+// 2Q: new pages go through the FIFO queue A1in. the ids of the pages
+// evicted from A1in are kept in the ghost queue A1out. a page that is
+// used again while it is remembered in A1out is hot and goes to the LRU
+// list Am. the references of a scan to the records of a page come in a
+// burst, so a page used again in A1in stays there, unless the other use
+// comes after a correlated reference period (a quarter of A1in's worth
+// of page admissions). then it is hot as well, which spares a hot page
+// the trip through A1out that a scan would cut short.
+//
+class BufferPool::TwoQReplacer : public BufferPool::Replacer {
+ public:
+  enum { A1IN, AM };
+
+  TwoQReplacer(size_t capacity)
+  {
+    // the 2Q paper suggests 25% of the pool for A1in and ghosts for
+    // half as many pages as the pool holds
+    inLimit = capacity / 4;
+    outLimit = capacity / PageFile::PAGE_SIZE / 2;
+    if (outLimit == 0) outLimit = 1;
+    correlated = inLimit / PageFile::PAGE_SIZE / 4;
+    admissions = 0;
+  }
+
+  void admit(Frame* f)
+  {
+    unsigned long long key = pageKey(f->fid, f->pid);
+    std::unordered_map<unsigned long long, std::list<unsigned long long>::iterator>::iterator it = ghosts.find(key);
+    if (it != ghosts.end()) {
+      // the page was used again after it left A1in. it is hot
+      a1out.erase(it->second);
+      ghosts.erase(it);
+      f->queue = AM;
+      am.pushFront(f);
+    } else {
+      f->queue = A1IN;
+      a1in.pushFront(f);
+    }
+    f->stamp = admissions++;
+  }
+
+  void touch(Frame* f)
+  {
+    if (f->queue == AM) {
+      am.unlink(f);
+      am.pushFront(f);
+    } else if (f->readAhead) {
+      // the first use of a page read ahead. its time in A1in starts now
+      f->stamp = admissions;
+    } else if (admissions - f->stamp > correlated) {
+      a1in.unlink(f);
+      f->queue = AM;
+      am.pushFront(f);
+    }
+  }
+
+  void remove(Frame* f, bool evicted)
+  {
+    if (f->queue == AM) {
+      am.unlink(f);
+      return;
+    }
+    a1in.unlink(f);
+
+    // remember the page evicted from A1in
+    if (evicted) {
+      unsigned long long key = pageKey(f->fid, f->pid);
+      a1out.push_front(key);
+      ghosts[key] = a1out.begin();
+      if (a1out.size() > outLimit) {
+        ghosts.erase(a1out.back());
+        a1out.pop_back();
+      }
+    }
+  }
+
+  Frame* victim()
+  {
+    // take from A1in while it is over its share of the pool
+    Frame* f = NULL;
+    if (a1in.bytes > inLimit || am.empty()) f = a1in.last();
+    if (f == NULL) f = am.last();
+    if (f == NULL) f = a1in.last();
+    return f;
+  }
+
+  void frames(std::vector<Frame*>& list)
+  {
+    a1in.append(list);
+    am.append(list);
+  }
+
+ private:
+  FrameList a1in;      // FIFO of the pages used once. the head is the newest
+  FrameList am;        // LRU list of the hot pages
+  size_t inLimit;      // max # bytes in A1in before it gives up pages
+  unsigned long long correlated;  // the correlated reference period
+  unsigned long long admissions;  // # pages admitted so far
+
+  std::list<unsigned long long> a1out;  // ghost FIFO of page keys
+  std::unordered_map<unsigned long long, std::list<unsigned long long>::iterator> ghosts;
+  size_t outLimit;     // max # keys in A1out
+};
+
+//
+// GreedyDual-Size-Frequency: a page is worth (L + uses * cost), where cost
+// is what it takes to bring the page back per byte of the pool it takes,
+// and L is the worth of the last page evicted. the pages that are not used
+// again lose worth relative to the pages admitted later. the uses of a
+// page in a burst (e.g., the records of a page read by a scan) count as
+// one use, so a scan does not make its pages look valuable.
+//
+class BufferPool::CostReplacer : public BufferPool::Replacer {
+ public:
+  CostReplacer() : inflation(0), clock(0) {}
+
+  void admit(Frame* f)
+  {
+    Entry& e = entries[f];
+    e.uses = 1;
+    e.last = clock++;
+    place(f, e, false);
+  }
+
+  void touch(Frame* f)
+  {
+    Entry& e = entries[f];
+    if (e.last + 1 != clock) e.uses++;
+    e.last = clock++;
+    place(f, e, true);
+  }
+
+  void remove(Frame* f, bool evicted)
+  {
+    std::unordered_map<Frame*, Entry>::iterator it = entries.find(f);
+    if (evicted && it->second.pos->first > inflation) inflation = it->second.pos->first;
+    queue.erase(it->second.pos);
+    entries.erase(it);
+  }
+
+  Frame* victim()
+  {
+    std::multimap<unsigned long long, Frame*>::iterator it;
+    for (it = queue.begin(); it != queue.end(); ++it) {
+      if (it->second->pins == 0) return it->second;
+    }
+    return NULL;
+  }
+
+  void frames(std::vector<Frame*>& list)
+  {
+    std::multimap<unsigned long long, Frame*>::iterator it;
+    for (it = queue.begin(); it != queue.end(); ++it) list.push_back(it->second);
+  }
+
+ private:
+  struct Entry {
+    std::multimap<unsigned long long, Frame*>::iterator pos; // in queue
+    unsigned long long uses;  // # uses of the page, bursts counted once
+    unsigned long long last;  // clock of the last use
+  };
+
+  // the cost of a page: one read to bring it back, and a write before
+  // that if it is dirty, per MAX_PAGE_SIZE bytes of the pool
+  static unsigned long long cost(const Frame* f)
+  {
+    return (f->owner != NULL ? 2 : 1) * (unsigned long long)(PageFile::MAX_PAGE_SIZE / f->size);
+  }
+
+  // (re)insert the page at its worth. pages of equal worth are evicted
+  // in the order they were placed
+  void place(Frame* f, Entry& e, bool queued)
+  {
+    if (queued) queue.erase(e.pos);
+    e.pos = queue.insert(std::make_pair(inflation + e.uses * cost(f), f));
+  }
+
+  std::multimap<unsigned long long, Frame*> queue; // the pages by worth
+  std::unordered_map<Frame*, Entry> entries;
+  unsigned long long inflation;  // L: the worth of the last page evicted
+  unsigned long long clock;      // # admissions and uses so far
+};
+
+//
+// a binary buddy allocator of the blocks of a part of the memory of the
+// pool. a block of 2^k KB is split into two buddies of 2^(k-1) KB on
+// demand, and the buddies merge again when both are free.
+//
+class BufferPool::Arena {
+ public:
+  Arena(char* base, size_t size) : base(base), size(size)
+  {
+    // cut the memory into the largest aligned blocks
+    size_t offset = 0;
+    for (int order = ORDERS - 1; order >= 0; order--) {
+      size_t block = (size_t)PageFile::PAGE_SIZE << order;
+      while (offset + block <= size) {
+        free[order].insert(offset / PageFile::PAGE_SIZE);
+        offset += block;
+      }
+    }
+  }
+
+  // a block for a page of the size. NULL if no block is free
+  char* alloc(int pageSize)
+  {
+    int order = orderOf(pageSize);
+    int k = order;
+    while (k < ORDERS && free[k].empty()) k++;
+    if (k == ORDERS) return NULL;
+
+    size_t unit = *free[k].begin();
+    free[k].erase(free[k].begin());
+    while (k > order) {
+      k--;
+      free[k].insert(unit + ((size_t)1 << k));
+    }
+    return base + unit * PageFile::PAGE_SIZE;
+  }
+
+  // give back the block of a page
+  void release(char* block, int pageSize)
+  {
+    size_t unit = (block - base) / PageFile::PAGE_SIZE;
+    int order = orderOf(pageSize);
+    for (; order < ORDERS - 1; order++) {
+      std::set<size_t>::iterator buddy = free[order].find(unit ^ ((size_t)1 << order));
+      if (buddy == free[order].end()) break;
+      free[order].erase(buddy);
+      unit &= ~((size_t)1 << order);
+    }
+    free[order].insert(unit);
+  }
+
+  bool owns(const char* p) const { return p >= base && p < base + size; }
+
+ private:
+  // a block of 2^k KB for k < ORDERS. the largest is MAX_PAGE_SIZE
+  static const int ORDERS = 7;
+
+  static int orderOf(int pageSize)
+  {
+    int order = 0;
+    while ((PageFile::PAGE_SIZE << order) < pageSize) order++;
+    return order;
+  }
+
+  char*  base;
+  size_t size;
+  std::set<size_t> free[ORDERS];  // the free blocks of 2^k KB, by
+                                  // offset in units of PAGE_SIZE
+};
+
+
+BufferPool::BufferPool(int frameCount, int shardCount, Policy policy)
+{
+  shards = NULL;
+  region = NULL;
+  regionSize = 0;
+  memory = REGULAR_PAGES;
+  hugePages = false;
+  this->policy = policy;
+  writes = 0;
+  allocate((size_t)frameCount * PageFile::PAGE_SIZE, shardCount, false);
+}
+
+BufferPool::~BufferPool()
+{
+  release();
+}
+
+BufferPool& BufferPool::global()
+{
+  static BufferPool pool;
+  return pool;
+}
+
+BufferPool::Replacer* BufferPool::newReplacer(Policy policy, size_t capacity)
+{
+  switch (policy) {
+  case TWO_Q:
+    return new TwoQReplacer(capacity);
+  case COST:
+    return new CostReplacer;
+  default:
+    return new LruReplacer;
+  }
+}
+
+RC BufferPool::resize(int frameCount, int shardCount)
+{
+  if (frameCount <= 0 || shardCount <= 0) return RC_INVALID_ATTRIBUTE;
+
+  release();
+  allocate((size_t)frameCount * PageFile::PAGE_SIZE, shardCount, hugePages);
+  return 0;
+}
+
+RC BufferPool::setMemoryBudget(size_t bytes, bool hugePages)
+{
+  if (bytes < (size_t)PageFile::PAGE_SIZE) return RC_INVALID_ATTRIBUTE;
+
+  release();
+  allocate(bytes, DEFAULT_SHARD_COUNT, hugePages);
+  return 0;
+}
+
+void BufferPool::setPolicy(Policy policy)
+{
+  this->policy = policy;
+
+  for (int i = 0; i < shardCount; i++) {
+    Shard& s = shards[i];
+    std::lock_guard<std::mutex> guard(s.latch);
+
+    // hand the pages over to the new policy, the most valuable last
+    std::vector<Frame*> list;
+    s.replacer->frames(list);
+    delete s.replacer;
+    s.replacer = newReplacer(policy, s.capacity);
+    for (unsigned j = 0; j < list.size(); j++) s.replacer->admit(list[j]);
+  }
+}
+
+void BufferPool::allocate(size_t bytes, int shardCount, bool hugePages)
+{
+  size_t frameCount = bytes / PageFile::PAGE_SIZE;
+
+  // a shard needs room for the largest page, or at least for one page
+  size_t most = frameCount * PageFile::PAGE_SIZE / PageFile::MAX_PAGE_SIZE;
+  if ((size_t)shardCount > most) shardCount = (most > 0) ? most : 1;
+
+  this->capacity = frameCount * PageFile::PAGE_SIZE;
+  this->shardCount = shardCount;
+  this->hugePages = hugePages;
+  shards = new Shard[shardCount];
+
+  // the part of the memory of a shard starts at a multiple of the
+  // largest page, so that every block is aligned to its size
+  std::vector<size_t> start(shardCount + 1);
+  for (int i = 0; i < shardCount; i++) {
+    size_t n = frameCount / shardCount + ((size_t)i < frameCount % shardCount ? 1 : 0);
+    size_t size = n * PageFile::PAGE_SIZE;
+    start[i + 1] = start[i] + (size + PageFile::MAX_PAGE_SIZE - 1) / PageFile::MAX_PAGE_SIZE * PageFile::MAX_PAGE_SIZE;
+  }
+
+  // allocate the memory of the pool in one piece. the memory is not
+  // touched until the pages are stored, so a large budget costs nothing
+  // until it is used
+  regionSize = start[shardCount];
+  if (hugePages) regionSize = (regionSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  void* addr = MAP_FAILED;
+  memory = REGULAR_PAGES;
+  if (hugePages) {
+    addr = ::mmap(NULL, regionSize, PROT_READ|PROT_WRITE,
+                  MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (addr != MAP_FAILED) memory = HUGE_PAGES;
+  }
+  if (addr == MAP_FAILED) {
+    addr = ::mmap(NULL, regionSize, PROT_READ|PROT_WRITE,
+                  MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (addr != MAP_FAILED && hugePages &&
+        ::madvise(addr, regionSize, MADV_HUGEPAGE) == 0) {
+      memory = TRANSPARENT_HUGE_PAGES;
+    }
+  }
+  if (addr == MAP_FAILED) {
+    // the frames come from the heap
+    region = NULL;
+    regionSize = 0;
+  } else {
+    region = (char*)addr;
+  }
+
+  // distribute the capacity over the shards as evenly as possible
+  for (int i = 0; i < shardCount; i++) {
+    Shard& s = shards[i];
+    size_t n = frameCount / shardCount + ((size_t)i < frameCount % shardCount ? 1 : 0);
+
+    s.capacity = n * PageFile::PAGE_SIZE;
+    s.used = 0;
+    s.hits = 0;
+    s.misses = 0;
+    s.replacer = newReplacer(policy, s.capacity);
+    s.arena = (region != NULL) ? new Arena(region + start[i], s.capacity) : new Arena(NULL, 0);
+    s.table.reserve(n);
+  }
+}
+
+void BufferPool::release()
+{
+  for (int i = 0; i < shardCount; i++) {
+    Shard& s = shards[i];
+    while (!s.table.empty()) discard(s, s.table.begin()->second);
+    delete s.replacer;
+    delete s.arena;
+  }
+  delete [] shards;
+  shards = NULL;
+  if (region != NULL) ::munmap(region, regionSize);
+  region = NULL;
+  regionSize = 0;
+  capacity = 0;
+  shardCount = 0;
+}
+
+char* BufferPool::allocFrame(Shard& s, int size)
+{
+  char* data = s.arena->alloc(size);
+  return (data != NULL) ? data : PageFile::allocBuffer(size);
+}
+
+void BufferPool::freeFrame(Shard& s, Frame* f)
+{
+  if (s.arena->owns(f->data)) {
+    s.arena->release(f->data, f->size);
+  } else {
+    PageFile::freeBuffer(f->data);
+  }
+}
+
+void BufferPool::discard(Shard& s, Frame* f)
+{
+  s.table.erase(pageKey(f->fid, f->pid));
+  s.replacer->remove(f, false);
+  s.used -= f->size;
+
+  // a guard still reads the page. the last unpin frees it
+  if (f->pins > 0) {
+    f->dropped = true;
+    return;
+  }
+  freeFrame(s, f);
+  delete f;
+}
+
+void BufferPool::pinFrame(Frame* f, PageGuard& guard)
+{
+  f->pins++;
+  guard.frame = f;
+  guard.page = f->data;
+  guard.pid = f->pid;
+}
+
+void BufferPool::unpin(Frame* f)
+{
+  Shard& s = shardOf(pageKey(f->fid, f->pid));
+  std::lock_guard<std::mutex> guard(s.latch);
+
+  if (--f->pins == 0 && f->dropped) {
+    freeFrame(s, f);
+    delete f;
+  }
+}
+
+bool BufferPool::get(int fid, PageId pid, void* buffer, bool* readAhead)
+{
+  unsigned long long key = pageKey(fid, pid);
+  Shard& s = shardOf(key);
+  std::lock_guard<std::mutex> guard(s.latch);
+
+  std::unordered_map<unsigned long long, Frame*>::iterator it = s.table.find(key);
+  if (it == s.table.end()) {
+    s.misses++;
+    return false;
+  }
+  s.hits++;
+
+  Frame* f = it->second;
+  s.replacer->touch(f);
+
+  memcpy(buffer, f->data, f->size);
+  if (readAhead != NULL) *readAhead = f->readAhead;
+  f->readAhead = false;
+  return true;
+}
+
+bool BufferPool::pin(int fid, PageId pid, PageGuard& guard, bool* readAhead)
+{
+  unsigned long long key = pageKey(fid, pid);
+  Shard& s = shardOf(key);
+
+  guard.release();
+  std::lock_guard<std::mutex> latch(s.latch);
+
+  std::unordered_map<unsigned long long, Frame*>::iterator it = s.table.find(key);
+  if (it == s.table.end()) {
+    s.misses++;
+    return false;
+  }
+  s.hits++;
+
+  Frame* f = it->second;
+  s.replacer->touch(f);
+
+  pinFrame(f, guard);
+  guard.pool = this;
+  if (readAhead != NULL) *readAhead = f->readAhead;
+  f->readAhead = false;
+  return true;
+}
+
+RC BufferPool::put(int fid, PageId pid, const void* buffer, int size, PageFile* owner)
+{
+  unsigned long long key = pageKey(fid, pid);
+  Shard& s = shardOf(key);
+  std::lock_guard<std::mutex> guard(s.latch);
+
+  // a clean page was written through to disk by the caller. counted
+  // under the latch, before the page can be evicted (see prefetch())
+  if (owner == NULL) writes++;
+  return store(s, key, fid, pid, buffer, size, owner);
+}
+
+RC BufferPool::fill(int fid, PageId pid, void* buffer, int size, PageGuard* guard)
+{
+  RC rc;
+  unsigned long long key = pageKey(fid, pid);
+  Shard& s = shardOf(key);
+
+  if (guard != NULL) guard->release();
+  std::lock_guard<std::mutex> latch(s.latch);
+
+  std::unordered_map<unsigned long long, Frame*>::iterator it = s.table.find(key);
+  if (it != s.table.end()) {
+    memcpy(buffer, it->second->data, size);
+  } else {
+    if ((rc = store(s, key, fid, pid, buffer, size, NULL)) < 0) return rc;
+    it = s.table.find(key);
+  }
+
+  if (guard != NULL) {
+    pinFrame(it->second, *guard);
+    guard->pool = this;
+  }
+  return 0;
+}
+
+RC BufferPool::prefetch(int fid, PageId pid, const void* buffer, int size,
+                        unsigned long long writes, bool* stored)
+{
+  RC rc;
+  unsigned long long key = pageKey(fid, pid);
+  Shard& s = shardOf(key);
+  std::lock_guard<std::mutex> guard(s.latch);
+
+  if (stored != NULL) *stored = false;
+  if (s.table.find(key) != s.table.end()) return 0;
+
+  // a write of the page that left the pool after the read is counted
+  // under this latch, so the page cannot slip through unnoticed
+  if (this->writes.load() != writes) return 0;
+
+  if ((rc = store(s, key, fid, pid, buffer, size, NULL)) < 0) return rc;
+  s.table[key]->readAhead = true;
+  if (stored != NULL) *stored = true;
+  return 0;
+}
+
+bool BufferPool::contains(int fid, PageId pid)
+{
+  unsigned long long key = pageKey(fid, pid);
+  Shard& s = shardOf(key);
+  std::lock_guard<std::mutex> guard(s.latch);
+
+  return s.table.find(key) != s.table.end();
+}
+
+RC BufferPool::store(Shard& s, unsigned long long key, int fid, PageId pid,
+                     const void* buffer, int size, PageFile* owner)
+{
+  RC rc;
+  Frame* f = NULL;
+
+  std::unordered_map<unsigned long long, Frame*>::iterator it = s.table.find(key);
+  if (it != s.table.end()) {
+    // the page is already cached. refresh its content
+    f = it->second;
+    f->readAhead = false;
+    f->owner = owner;
+    s.replacer->touch(f);
+  } else {
+    // evict the pages chosen by the replacement policy until the new
+    // page fits. the frame of an evicted page of the same size is reused
+    Frame* victim;
+    while (s.used + size > s.capacity && (victim = s.replacer->victim()) != NULL) {
+      if ((rc = evict(s, victim)) < 0) {
+        if (f != NULL) { freeFrame(s, f); delete f; }
+        return rc;
+      }
+      if (f == NULL && victim->size == size) {
+        f = victim;
+      } else {
+        freeFrame(s, victim);
+        delete victim;
+      }
+    }
+
+    // the free memory of the shard may be split into blocks smaller
+    // than the page. evict more pages until a block of its size is free
+    char* data = NULL;
+    while (f == NULL && (data = s.arena->alloc(size)) == NULL &&
+           (victim = s.replacer->victim()) != NULL) {
+      if ((rc = evict(s, victim)) < 0) return rc;
+      if (victim->size == size) {
+        f = victim;
+      } else {
+        freeFrame(s, victim);
+        delete victim;
+      }
+    }
+
+    if (f == NULL) {
+      f = new Frame;
+      f->size = size;
+      f->pins = 0;
+      f->dropped = false;
+      f->data = (data != NULL) ? data : allocFrame(s, size);
+    }
+    f->fid = fid;
+    f->pid = pid;
+    f->owner = owner;
+    s.used += size;
+    s.table[key] = f;
+    s.replacer->admit(f);
+  }
+
+  f->readAhead = false;
+  memcpy(f->data, buffer, size);
+  return 0;
+}
+
+RC BufferPool::evict(Shard& s, Frame* victim)
+{
+  RC rc;
+
+  // a dirty page has to be written back first
+  if (victim->owner != NULL) {
+    if ((rc = victim->owner->writePage(victim->pid, victim->data)) < 0) return rc;
+    victim->owner = NULL;
+    writes++;
+  }
+  s.table.erase(pageKey(victim->fid, victim->pid));
+  s.replacer->remove(victim, true);
+  s.used -= victim->size;
+  return 0;
+}
+
+RC BufferPool::flushFile(int fid, PageFile* owner)
+{
+  RC rc = 0;
+
+  for (int i = 0; i < shardCount; i++) {
+    Shard& s = shards[i];
+    std::lock_guard<std::mutex> guard(s.latch);
+
+    std::unordered_map<unsigned long long, Frame*>::iterator it;
+    for (it = s.table.begin(); it != s.table.end(); ++it) {
+      Frame* f = it->second;
+      if (f->fid != fid || f->owner != owner) continue;
+      if ((rc = owner->writePage(f->pid, f->data)) < 0) return rc;
+      f->owner = NULL;
+      writes++;
+    }
+  }
+
+  return rc;
+}
+
+void BufferPool::invalidate(int fid, PageId pid)
+{
+  unsigned long long key = pageKey(fid, pid);
+  Shard& s = shardOf(key);
+  std::lock_guard<std::mutex> guard(s.latch);
+
+  std::unordered_map<unsigned long long, Frame*>::iterator it = s.table.find(key);
+  if (it != s.table.end()) discard(s, it->second);
+}
+
+void BufferPool::invalidateFile(int fid)
+{
+  for (int i = 0; i < shardCount; i++) {
+    Shard& s = shards[i];
+    std::lock_guard<std::mutex> guard(s.latch);
+
+    std::vector<Frame*> drop;
+    std::unordered_map<unsigned long long, Frame*>::iterator it;
+    for (it = s.table.begin(); it != s.table.end(); ++it) {
+      if (it->second->fid == fid) drop.push_back(it->second);
+    }
+    for (unsigned j = 0; j < drop.size(); j++) discard(s, drop[j]);
+  }
+}
+
+size_t BufferPool::getUsed() const
+{
+  size_t used = 0;
+  for (int i = 0; i < shardCount; i++) {
+    std::lock_guard<std::mutex> guard(shards[i].latch);
+    used += shards[i].used;
+  }
+  return used;
+}
+
+long long BufferPool::getHitCount() const
+{
+  long long count = 0;
+  for (int i = 0; i < shardCount; i++) {
+    std::lock_guard<std::mutex> guard(shards[i].latch);
+    count += shards[i].hits;
+  }
+  return count;
+}
+
+long long BufferPool::getMissCount() const
+{
+  long long count = 0;
+  for (int i = 0; i < shardCount; i++) {
+    std::lock_guard<std::mutex> guard(shards[i].latch);
+    count += shards[i].misses;
+  }
+  return count;
+}
+
+void BufferPool::resetStats()
+{
+  for (int i = 0; i < shardCount; i++) {
+    std::lock_guard<std::mutex> guard(shards[i].latch);
+    shards[i].hits = 0;
+    shards[i].misses = 0;
+  }
+}
+
+PageGuard::PageGuard(PageGuard&& other)
+  : pool(other.pool), frame(other.frame), page(other.page), pid(other.pid)
+{
+  copy.swap(other.copy);
+  other.pool = NULL;
+  other.frame = NULL;
+  other.page = NULL;
+  other.pid = -1;
+}
+
+PageGuard& PageGuard::operator=(PageGuard&& other)
+{
+  if (this == &other) return *this;
+
+  release();
+  pool = other.pool;
+  frame = other.frame;
+  page = other.page;
+  pid = other.pid;
+  copy.swap(other.copy);
+  other.pool = NULL;
+  other.frame = NULL;
+  other.page = NULL;
+  other.pid = -1;
+  return *this;
+}
+
+void PageGuard::release()
+{
+  if (frame != NULL) pool->unpin(frame);
+  pool = NULL;
+  frame = NULL;
+  page = NULL;
+  pid = -1;
+}
@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+class PageGuard;
+
+/**
+ * A process-wide cache of disk pages shared by all open PageFiles.
+ * A cached page is identified by (fid, pid), where fid is the unique id
+ * that PageFile assigns to every open file. Since files may use
+ * different page sizes, the capacity of the pool is counted in bytes and
+ * every frame holds exactly one page. The pool is split into shards,
+ * each with its own latch, hash table and replacement policy, so that a
+ * lookup only locks the shard that owns the page, and any number of
+ * threads can use the pool at the same time.
+ * The replacement policy is either plain LRU or 2Q, which keeps the
+ * pages of a large scan from pushing out the pages that are used again
+ * and again (e.g., the root and inner nodes of a B+tree).
+ * A page written by a PageFile opened in write-back mode is kept dirty
+ * in the pool and written to disk by its owner when it is evicted or
+ * when the owner flushes the file.
+ * A page can be pinned to read it in place in its frame. A pinned page
+ * is never evicted, and its frame outlives even an invalidation of the
+ * page until the last PageGuard on it is released.
+ * The frames are carved out of one memory region of the size of the
+ * pool, optionally backed by huge pages, which is split among the shards.
+ * A shard hands out the frames of its part with a buddy allocator, so
+ * pages of any size share the memory, which goes to whatever files are
+ * in use. The pool only takes memory outside of the region when it is
+ * full of pinned pages.
+ */
+class BufferPool {
+ public:
+  static const int DEFAULT_FRAME_COUNT = 4096;  // 4MB of 1KB pages
+  static const int DEFAULT_SHARD_COUNT = 16;
+
+  //
+  // page replacement policies
+  //
+  enum Policy {
+    // evict the least recently used page
+    LRU,
+    // 2Q (Johnson and Shasha, VLDB '94). a page enters a FIFO queue
+    // (A1in) that takes a quarter of the pool. a page evicted from A1in
+    // is remembered in a ghost queue (A1out), and only a page used again
+    // while in A1out moves to the LRU list of hot pages (Am). a scan
+    // passes through A1in without disturbing Am
+    TWO_Q,
+    // GreedyDual-Size-Frequency (Cherkasova, HPL-98-69). a page is worth
+    // what it costs to bring it back (one read, and a write first if it
+    // is dirty) per byte of the pool it takes, times the # of times it
+    // was used. the page worth the least is evicted, and the pages that
+    // stay age by the worth of the evicted page
+    COST
+  };
+  static const Policy DEFAULT_POLICY = TWO_Q;
+
+  //
+  // the kind of memory the frames are allocated from
+  //
+  enum Memory {
+    REGULAR_PAGES,          // pages of the system page size
+    TRANSPARENT_HUGE_PAGES, // regular pages the kernel may back with
+                            //   huge pages (madvise(MADV_HUGEPAGE))
+    HUGE_PAGES              // 2MB pages reserved for hugetlbfs
+  };
+  static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+  /**
+   * create a buffer pool.
+   * @param frameCount[IN] size of the pool in units of
+   *                       PageFile::PAGE_SIZE (1KB) frames
+   * @param shardCount[IN] # of independently latched partitions
+   * @param policy[IN] the page replacement policy
+   */
+  BufferPool(int frameCount = DEFAULT_FRAME_COUNT,
+             int shardCount = DEFAULT_SHARD_COUNT,
+             Policy policy = DEFAULT_POLICY);
+  ~BufferPool();
+
+  /**
+   * the buffer pool used by every PageFile in this process.
+   */
+  static BufferPool& global();
+
+  /**
+   * change the size of the pool. all cached pages are dropped.
+   * no page may be pinned.
+   * @param frameCount[IN] size of the pool in units of 1KB frames
+   * @param shardCount[IN] # of independently latched partitions
+   * @return error code. 0 if no error
+   */
+  RC resize(int frameCount, int shardCount = DEFAULT_SHARD_COUNT);
+
+  /**
+   * set the memory budget of the pool. all cached pages are dropped.
+   * no page may be pinned. with hugePages, the memory is allocated in
+   * 2MB huge pages if the system has them reserved, and is marked for
+   * transparent huge pages otherwise.
+   * @param bytes[IN] size of the pool in bytes
+   * @param hugePages[IN] true to back the pool with huge pages
+   * @return error code. 0 if no error
+   */
+  RC setMemoryBudget(size_t bytes, bool hugePages);
+
+  /**
+   * change the page replacement policy. the cached pages stay in the pool.
+   * @param policy[IN] the new policy
+   */
+  void setPolicy(Policy policy);
+
+  /**
+   * @return the page replacement policy
+   */
+  Policy getPolicy() const { return policy; }
+
+  /**
+   * copy the cached page (fid, pid) to buffer.
+   * @param fid[IN] file id of the page
+   * @param pid[IN] page id of the page
+   * @param buffer[OUT] memory buffer as large as the page
+   * @param readAhead[OUT] if given, set to true when the page was
+   *                       brought in by read-ahead and this is its first use
+   * @return true if the page was found in the pool
+   */
+  bool get(int fid, PageId pid, void* buffer, bool* readAhead = NULL);
+
+  /**
+   * pin the cached page (fid, pid), so that guard can read it in place
+   * until the guard is released.
+   * @param fid[IN] file id of the page
+   * @param pid[IN] page id of the page
+   * @param guard[OUT] the guard that holds the pin
+   * @param readAhead[OUT] as in get()
+   * @return true if the page was found in the pool
+   */
+  bool pin(int fid, PageId pid, PageGuard& guard, bool* readAhead = NULL);
+
+  /**
+   * store a copy of the page (fid, pid) in the pool, evicting the
+   * page chosen by the replacement policy if necessary.
+   * if owner is given, the page is marked dirty and is written back
+   * through owner when it leaves the pool. otherwise the page is
+   * assumed to be identical to its copy on disk.
+   * @param fid[IN] file id of the page
+   * @param pid[IN] page id of the page
+   * @param buffer[IN] the page content
+   * @param size[IN] the page size of the file
+   * @param owner[IN] the PageFile that writes the dirty page back
+   * @return error code. 0 if no error. an error is returned when the
+   *         write-back of an evicted dirty page fails
+   */
+  RC put(int fid, PageId pid, const void* buffer, int size,
+         PageFile* owner = NULL);
+
+  /**
+   * store a page just read from disk in the pool. if the pool already
+   * has a copy of the page, it may have been written after the disk
+   * read, so the cached copy is kept and copied to buffer instead.
+   * @param fid[IN] file id of the page
+   * @param pid[IN] page id of the page
+   * @param buffer[IN/OUT] the page read from disk
+   * @param size[IN] the page size of the file
+   * @param guard[OUT] if given, the page in the pool is pinned by guard
+   * @return error code. 0 if no error
+   */
+  RC fill(int fid, PageId pid, void* buffer, int size, PageGuard* guard = NULL);
+
+  /**
+   * store a page read ahead of its use unless the pool has it already.
+   * the first get() of the page reports it as a read-ahead hit.
+   * the page is not stored either if a page was written to disk through
+   * the pool after the read was issued: the read may have missed the
+   * write, e.g., of a dirty page of the same window that storing an
+   * earlier page of the window evicted.
+   * @param fid[IN] file id of the page
+   * @param pid[IN] page id of the page
+   * @param buffer[IN] the page read from disk
+   * @param size[IN] the page size of the file
+   * @param writes[IN] getWriteCount() before the read was issued
+   * @param stored[OUT] if given, set to true if the page was stored
+   * @return error code. 0 if no error
+   */
+  RC prefetch(int fid, PageId pid, const void* buffer, int size,
+              unsigned long long writes, bool* stored = NULL);
+
+  /**
+   * check if the page (fid, pid) is cached, without counting a hit or
+   * a miss or telling the replacement policy.
+   * @param fid[IN] file id of the page
+   * @param pid[IN] page id of the page
+   * @return true if the page is in the pool
+   */
+  bool contains(int fid, PageId pid);
+
+  /**
+   * @return # pages written to disk through the pool so far: the dirty
+   *         pages written back, and the pages written through by put()
+   */
+  unsigned long long getWriteCount() const { return writes.load(); }
+
+  /**
+   * write every dirty page of the file fid owned by owner to disk.
+   * the pages stay in the pool as clean pages.
+   * @param fid[IN] file id of the pages to flush
+   * @param owner[IN] the PageFile that owns the dirty pages
+   * @return error code. 0 if no error
+   */
+  RC flushFile(int fid, PageFile* owner);
+
+  /**
+   * drop the page (fid, pid) from the pool if it is cached.
+   */
+  void invalidate(int fid, PageId pid);
+
+  /**
+   * drop every cached page of the file fid. dirty pages are discarded.
+   */
+  void invalidateFile(int fid);
+
+  /**
+   * @return the size of the pool in bytes
+   */
+  size_t getCapacity() const { return capacity; }
+
+  /**
+   * @return # bytes of pages in the pool
+   */
+  size_t getUsed() const;
+
+  /**
+   * @return the kind of memory backing the pool
+   */
+  Memory getMemory() const { return memory; }
+
+  /**
+   * @return # of get() calls that found the page in the pool
+   */
+  long long getHitCount() const;
+
+  /**
+   * @return # of get() calls that did not find the page in the pool
+   */
+  long long getMissCount() const;
+
+  /**
+   * set the hit and miss counts to zero.
+   */
+  void resetStats();
+
+ private:
+  struct Frame {
+    int    fid;     // file id of the cached page
+    PageId pid;     // page id of the cached page
+    int    size;    // the page size
+    Frame* prev;    // links of the list of the replacement policy
+    Frame* next;    //   that holds the frame
+    int    queue;   // which list of the policy holds the frame
+    unsigned long long stamp; // when the policy last saw the page
+    PageFile* owner; // the PageFile that writes the page back.
+                     //   (owner != NULL) means that the page is dirty
+    bool   readAhead; // read ahead and not used yet
+    int    pins;    // # PageGuards on the page. a pinned page stays
+    bool   dropped; // the page left the pool while it was pinned.
+                    //   the last unpin frees the frame
+    char*  data;    // the page content. aligned for DIRECT I/O
+  };
+
+  friend class PageGuard;
+
+  // a page replacement policy of a shard. it is called with the
+  // shard latch held
+  class Replacer;
+  class LruReplacer;
+  class TwoQReplacer;
+  class CostReplacer;
+
+  // the buddy allocator of the frames of a shard
+  class Arena;
+
+  struct Shard {
+    std::mutex latch;
+    std::unordered_map<unsigned long long, Frame*> table;
+    Replacer* replacer;      // decides which page to evict
+    Arena* arena;            // the memory of the frames
+    size_t capacity;         // max # bytes of pages in the shard
+    size_t used;             // # bytes of pages in the shard
+    long long hits;          // # get() calls that found the page
+    long long misses;        // # get() calls that did not
+  };
+
+  static Replacer* newReplacer(Policy policy, size_t capacity);
+
+  static unsigned long long pageKey(int fid, PageId pid)
+    { return ((unsigned long long)(unsigned)fid << 32) | (unsigned)pid; }
+
+  Shard& shardOf(unsigned long long key)
+    { return shards[(key * 0x9E3779B97F4A7C15ULL >> 32) % shardCount]; }
+
+  // allocate and free the content of a frame of a shard. the memory
+  // comes from the heap when the arena of the shard is full
+  static char* allocFrame(Shard& s, int size);
+  static void freeFrame(Shard& s, Frame* f);
+
+  // take a page chosen by the replacement policy out of a shard whose
+  // latch is held by the caller, writing it back if it is dirty. the
+  // frame is left to the caller
+  RC evict(Shard& s, Frame* victim);
+
+  // store a page in a shard whose latch is held by the caller
+  RC store(Shard& s, unsigned long long key, int fid, PageId pid,
+           const void* buffer, int size, PageFile* owner);
+
+  // drop a frame from its shard and free it, or leave it to the
+  // last unpin if it is pinned
+  static void discard(Shard& s, Frame* f);
+
+  // pin a frame of a shard whose latch is held by the caller
+  static void pinFrame(Frame* f, PageGuard& guard);
+
+  // release a pin taken by pinFrame()
+  void unpin(Frame* f);
+
+  void allocate(size_t bytes, int shardCount, bool hugePages);
+  void release();
+
+  size_t capacity;   // size of the pool in bytes
+  char*  region;     // the memory of the frames
+  size_t regionSize; // size of the region in bytes
+  Memory memory;     // what backs the region
+  bool   hugePages;  // huge pages were asked for
+  Policy policy;     // the page replacement policy
+  std::atomic<unsigned long long> writes; // see getWriteCount()
+  int    shardCount;
+  Shard* shards;
+
+  BufferPool(const BufferPool&);
+  BufferPool& operator=(const BufferPool&);
+};
+
+/**
+ * A pin on a page, which gives read access to the page in place, without
+ * copying it out of the buffer pool. The page stays in memory until the
+ * guard is released or destroyed. A guard can be moved but not copied.
+ * The page content must not be modified through the guard; pages are
+ * written with PageFile::write().
+ */
+class PageGuard {
+ public:
+  PageGuard() : pool(NULL), frame(NULL), page(NULL), pid(-1) {}
+  PageGuard(PageGuard&& other);
+  PageGuard& operator=(PageGuard&& other);
+  ~PageGuard() { release(); }
+
+  /**
+   * @return the content of the pinned page. NULL if no page is pinned
+   */
+  const char* data() const { return page; }
+
+  /**
+   * @return the id of the pinned page. -1 if no page is pinned
+   */
+  PageId pageId() const { return pid; }
+
+  /**
+   * release the pin. the pointer returned by data() becomes invalid.
+   */
+  void release();
+
+ private:
+  friend class BufferPool;
+  friend class PageFile;
+
+  BufferPool* pool;         // the pool of the pinned frame
+  BufferPool::Frame* frame; // the pinned frame. NULL if the page is a copy
+  const char* page;         // the page content
+  PageId pid;               // the id of the page
+  std::vector<char> copy;   // a private copy, where pinning is not possible
+
+  PageGuard(const PageGuard&);
+  PageGuard& operator=(const PageGuard&);
+};
+
+#endif // BUFFERPOOL_H
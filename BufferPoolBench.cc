@@ -0,0 +1,121 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+//
+// compares the hit ratio of the buffer pool replacement policies on a
+// workload that mixes full table scans with indexed point lookups.
+//
+// the simulated database has a table of TABLE_PAGES pages, loaded in key
+// order, and a three-level B+tree over it. a point lookup reads the root,
+// one inner node, one leaf and one table page. 80% of the lookups go to
+// 5% of the keys. a scan reads every table page, and every page as many
+// times as it has records. the pool is smaller than the table, so every
+// scan alone would flush an LRU pool.
+//
+// usage: bpbench [frames]
+//
+
+#include "Bruinbase.h"
+#include "BufferPool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static const int TABLE_FID = 1;
+static const int INDEX_FID = 2;
+
+static const int TABLE_PAGES = 20000;
+static const int RECORDS_PER_PAGE = 9;
+static const int KEYS = TABLE_PAGES * RECORDS_PER_PAGE;
+static const int KEYS_PER_LEAF = 90;
+static const int LEAF_NODES = (KEYS + KEYS_PER_LEAF - 1) / KEYS_PER_LEAF;
+static const int LEAVES_PER_INNER = 80;
+static const int INNER_NODES = (LEAF_NODES + LEAVES_PER_INNER - 1) / LEAVES_PER_INNER;
+static const int HOT_KEYS = KEYS / 20;
+
+static const int ROUNDS = 20;
+static const int LOOKUPS_PER_ROUND = 1000;
+
+struct Result {
+  long long indexHits;    // hits of the B+tree pages read by lookups
+  long long indexReads;
+  long long lookupHits;   // hits of all pages read by lookups
+  long long lookupReads;
+  long long hits;         // hits of all pages
+  long long reads;
+};
+
+// read a page through the pool the way PageFile::read() does
+static bool readPage(BufferPool& pool, int fid, PageId pid, char* page)
+{
+  if (pool.get(fid, pid, page)) return true;
+  pool.fill(fid, pid, page, PageFile::PAGE_SIZE);
+  return false;
+}
+
+static Result run(BufferPool::Policy policy, int frames)
+{
+  BufferPool pool(frames, BufferPool::DEFAULT_SHARD_COUNT, policy);
+  std::mt19937 random(2008);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int> hotKey(0, HOT_KEYS - 1);
+  std::uniform_int_distribution<int> anyKey(0, KEYS - 1);
+  char page[PageFile::PAGE_SIZE] = { 0 };
+  Result r = { 0, 0, 0, 0, 0, 0 };
+
+  for (int round = 0; round < ROUNDS; round++) {
+    // the point lookups. pid 0 of the index is the root
+    for (int i = 0; i < LOOKUPS_PER_ROUND; i++) {
+      int key = (percent(random) < 80) ? hotKey(random) : anyKey(random);
+      int leaf = key / KEYS_PER_LEAF;
+      PageId path[3] = { 0, 1 + leaf / LEAVES_PER_INNER, 1 + INNER_NODES + leaf };
+      for (int j = 0; j < 3; j++) {
+        r.indexHits += readPage(pool, INDEX_FID, path[j], page);
+      }
+      r.indexReads += 3;
+      r.lookupHits += readPage(pool, TABLE_FID, key / RECORDS_PER_PAGE, page);
+      r.lookupReads++;
+    }
+
+    // a full scan of the table
+    for (PageId pid = 0; pid < TABLE_PAGES; pid++) {
+      for (int i = 0; i < RECORDS_PER_PAGE; i++) {
+        r.hits += readPage(pool, TABLE_FID, pid, page);
+        r.reads++;
+      }
+    }
+  }
+
+  r.lookupHits += r.indexHits;
+  r.lookupReads += r.indexReads;
+  r.hits += r.lookupHits;
+  r.reads += r.lookupReads;
+  return r;
+}
+
+int main(int argc, char* argv[])
+{
+  int frames = (argc > 1) ? atoi(argv[1]) : BufferPool::DEFAULT_FRAME_COUNT;
+  if (frames <= 0) {
+    fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+    return 1;
+  }
+
+  const char* names[] = { "LRU", "2Q", "COST" };
+  BufferPool::Policy policies[] = { BufferPool::LRU, BufferPool::TWO_Q, BufferPool::COST };
+
+  printf("%d frames, %d table pages, %d rounds of %d lookups and a scan\n",
+         frames, TABLE_PAGES, ROUNDS, LOOKUPS_PER_ROUND);
+  printf("%-8s %12s %12s %12s\n", "policy", "index hits", "lookup hits", "all hits");
+  for (int i = 0; i < 3; i++) {
+    Result r = run(policies[i], frames);
+    printf("%-8s %11.1f%% %11.1f%% %11.1f%%\n", names[i],
+           100.0 * r.indexHits / r.indexReads,
+           100.0 * r.lookupHits / r.lookupReads, 100.0 * r.hits / r.reads);
+  }
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "IOStats.h"
+#include <time.h>
+
+static const std::memory_order relaxed = std::memory_order_relaxed;
+
+IOStats::Snapshot::Snapshot()
+{
+  cacheHits = cacheMisses = readAheadHits = 0;
+  pageReads = pageWrites = 0;
+  bytesRead = bytesWritten = 0;
+  readCalls = writeCalls = 0;
+  readNanos = writeNanos = 0;
+  extensions = preallocations = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    readLatency[i] = writeLatency[i] = 0;
+  }
+}
+
+IOStats::Snapshot IOStats::Snapshot::operator-(const Snapshot& other) const
+{
+  Snapshot d;
+  d.cacheHits = cacheHits - other.cacheHits;
+  d.cacheMisses = cacheMisses - other.cacheMisses;
+  d.readAheadHits = readAheadHits - other.readAheadHits;
+  d.pageReads = pageReads - other.pageReads;
+  d.pageWrites = pageWrites - other.pageWrites;
+  d.bytesRead = bytesRead - other.bytesRead;
+  d.bytesWritten = bytesWritten - other.bytesWritten;
+  d.readCalls = readCalls - other.readCalls;
+  d.writeCalls = writeCalls - other.writeCalls;
+  d.readNanos = readNanos - other.readNanos;
+  d.writeNanos = writeNanos - other.writeNanos;
+  d.extensions = extensions - other.extensions;
+  d.preallocations = preallocations - other.preallocations;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    d.readLatency[i] = readLatency[i] - other.readLatency[i];
+    d.writeLatency[i] = writeLatency[i] - other.writeLatency[i];
+  }
+  return d;
+}
+
+bool IOStats::Snapshot::empty() const
+{
+  return cacheHits == 0 && cacheMisses == 0 && pageReads == 0 &&
+         pageWrites == 0 && readCalls == 0 && writeCalls == 0 &&
+         extensions == 0 && preallocations == 0;
+}
+
+// describe the average latency of the timed calls of a histogram.
+// asynchronous calls are not timed
+static const char* averageLatency(char* text, const long long* histogram, long long nanos)
+{
+  long long timed = 0;
+  for (int i = 0; i < IOStats::LATENCY_BUCKETS; i++) timed += histogram[i];
+  if (timed == 0) return "not timed";
+  snprintf(text, 32, "avg %.1fus", (double)nanos / timed / 1000);
+  return text;
+}
+
+void IOStats::Snapshot::print(FILE* out, const char* name) const
+{
+  char readText[32], writeText[32];
+  fprintf(out, "%s: %lld hits (%lld read ahead), %lld misses, "
+          "%lld pages read, %lld pages written, "
+          "%lld bytes read in %lld calls (%s), "
+          "%lld bytes written in %lld calls (%s), "
+          "%lld extensions, %lld preallocations\n",
+          name, cacheHits, readAheadHits, cacheMisses, pageReads, pageWrites,
+          bytesRead, readCalls, averageLatency(readText, readLatency, readNanos),
+          bytesWritten, writeCalls, averageLatency(writeText, writeLatency, writeNanos),
+          extensions, preallocations);
+}
+
+// print the non-empty buckets of a latency histogram
+static void printHistogram(FILE* out, const char* name, const long long* histogram)
+{
+  fprintf(out, "  %s latency (us):\n", name);
+  for (int i = 0; i < IOStats::LATENCY_BUCKETS; i++) {
+    if (histogram[i] == 0) continue;
+    long long low = (i == 0) ? 0 : (1LL << (i - 1));
+    if (i == IOStats::LATENCY_BUCKETS - 1) {
+      fprintf(out, "    [%lld, inf) %lld\n", low, histogram[i]);
+    } else {
+      fprintf(out, "    [%lld, %lld) %lld\n", low, 1LL << i, histogram[i]);
+    }
+  }
+}
+
+void IOStats::Snapshot::printLatency(FILE* out) const
+{
+  printHistogram(out, "read", readLatency);
+  printHistogram(out, "write", writeLatency);
+}
+
+IOStats::IOStats(IOStats* parent)
+  : cacheHits(0), cacheMisses(0), readAheadHits(0), pageReads(0),
+    pageWrites(0), bytesRead(0), bytesWritten(0), readCalls(0),
+    writeCalls(0), readNanos(0), writeNanos(0), extensions(0),
+    preallocations(0), parent(parent)
+{
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    readLatency[i] = 0;
+    writeLatency[i] = 0;
+  }
+}
+
+void IOStats::hit(bool readAhead)
+{
+  cacheHits.fetch_add(1, relaxed);
+  if (readAhead) readAheadHits.fetch_add(1, relaxed);
+  if (parent != NULL) parent->hit(readAhead);
+}
+
+void IOStats::miss()
+{
+  cacheMisses.fetch_add(1, relaxed);
+  if (parent != NULL) parent->miss();
+}
+
+void IOStats::pagesRead(int count)
+{
+  pageReads.fetch_add(count, relaxed);
+  if (parent != NULL) parent->pagesRead(count);
+}
+
+void IOStats::pagesWritten(int count)
+{
+  pageWrites.fetch_add(count, relaxed);
+  if (parent != NULL) parent->pagesWritten(count);
+}
+
+void IOStats::readCall(ssize_t bytes, long long nanos)
+{
+  readCalls.fetch_add(1, relaxed);
+  if (bytes > 0) bytesRead.fetch_add(bytes, relaxed);
+  if (nanos >= 0) {
+    readNanos.fetch_add(nanos, relaxed);
+    readLatency[bucketOf(nanos)].fetch_add(1, relaxed);
+  }
+  if (parent != NULL) parent->readCall(bytes, nanos);
+}
+
+void IOStats::writeCall(ssize_t bytes, long long nanos)
+{
+  writeCalls.fetch_add(1, relaxed);
+  if (bytes > 0) bytesWritten.fetch_add(bytes, relaxed);
+  if (nanos >= 0) {
+    writeNanos.fetch_add(nanos, relaxed);
+    writeLatency[bucketOf(nanos)].fetch_add(1, relaxed);
+  }
+  if (parent != NULL) parent->writeCall(bytes, nanos);
+}
+
+void IOStats::extended()
+{
+  extensions.fetch_add(1, relaxed);
+  if (parent != NULL) parent->extended();
+}
+
+void IOStats::preallocated()
+{
+  preallocations.fetch_add(1, relaxed);
+  if (parent != NULL) parent->preallocated();
+}
+
+IOStats::Snapshot IOStats::snapshot() const
+{
+  Snapshot s;
+  s.cacheHits = cacheHits.load(relaxed);
+  s.cacheMisses = cacheMisses.load(relaxed);
+  s.readAheadHits = readAheadHits.load(relaxed);
+  s.pageReads = pageReads.load(relaxed);
+  s.pageWrites = pageWrites.load(relaxed);
+  s.bytesRead = bytesRead.load(relaxed);
+  s.bytesWritten = bytesWritten.load(relaxed);
+  s.readCalls = readCalls.load(relaxed);
+  s.writeCalls = writeCalls.load(relaxed);
+  s.readNanos = readNanos.load(relaxed);
+  s.writeNanos = writeNanos.load(relaxed);
+  s.extensions = extensions.load(relaxed);
+  s.preallocations = preallocations.load(relaxed);
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    s.readLatency[i] = readLatency[i].load(relaxed);
+    s.writeLatency[i] = writeLatency[i].load(relaxed);
+  }
+  return s;
+}
+
+long long IOStats::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int IOStats::bucketOf(long long nanos)
+{
+  long long micros = nanos / 1000;
+  int i = 0;
+  while (micros > 0 && i < LATENCY_BUCKETS - 1) {
+    micros >>= 1;
+    i++;
+  }
+  return i;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include <atomic>
+#include <cstdio>
+#include <sys/types.h>
+
+/**
+ * I/O counters of a file, or of all files together.
+ * The counters are 64-bit atomics, so any number of threads can update
+ * them at the same time and they do not overflow in a long-running
+ * process. The latency of every read and write system call is recorded
+ * in a histogram with power-of-two buckets of microseconds.
+ * An update of a file's counters is added to its parent (the totals of
+ * all files) as well.
+ */
+class IOStats {
+ public:
+  // bucket 0 counts the calls that took less than 1us, bucket i (i > 0)
+  // the calls that took [2^(i-1), 2^i) us. the last bucket counts all
+  // calls that took longer
+  static const int LATENCY_BUCKETS = 24;
+
+  /**
+   * a copy of the counters at one point in time. the difference of two
+   * snapshots gives the I/O of what ran in between (e.g., a query).
+   */
+  struct Snapshot {
+    long long cacheHits;     // page reads served by the buffer pool
+    long long cacheMisses;   // page reads that had to go to disk
+    long long readAheadHits; // cache hits on pages read ahead
+    long long pageReads;     // # pages read from disk
+    long long pageWrites;    // # pages written to disk
+    long long bytesRead;     // # bytes returned by read calls
+    long long bytesWritten;  // # bytes taken by write calls
+    long long readCalls;     // # read system calls
+    long long writeCalls;    // # write system calls
+    long long readNanos;     // total time spent in timed read calls
+    long long writeNanos;    // total time spent in timed write calls
+    long long extensions;    // # writes that grew the file on disk
+    long long preallocations; // # extents reserved ahead of the writes
+    long long readLatency[LATENCY_BUCKETS];
+    long long writeLatency[LATENCY_BUCKETS];
+
+    Snapshot();
+    Snapshot operator-(const Snapshot& other) const;
+
+    /**
+     * @return true if no I/O was counted
+     */
+    bool empty() const;
+
+    /**
+     * print the counters in one line.
+     * @param out[IN] the stream to print to
+     * @param name[IN] what the counters belong to (e.g., a file name)
+     */
+    void print(FILE* out, const char* name) const;
+
+    /**
+     * print the latency histograms of the read and write calls.
+     * empty buckets are skipped.
+     * @param out[IN] the stream to print to
+     */
+    void printLatency(FILE* out) const;
+  };
+
+  IOStats(IOStats* parent = NULL);
+
+  /**
+   * set the counters that every update is added to as well.
+   */
+  void setParent(IOStats* p) { parent = p; }
+
+  /**
+   * count a page read served by the buffer pool.
+   * @param readAhead[IN] true if the page was read ahead of its use
+   */
+  void hit(bool readAhead);
+
+  /**
+   * count a page read that was not served by the buffer pool.
+   */
+  void miss();
+
+  /**
+   * count pages read from or written to disk.
+   */
+  void pagesRead(int count);
+  void pagesWritten(int count);
+
+  /**
+   * count a read or write system call.
+   * @param bytes[IN] the result of the call. -1 if it failed
+   * @param nanos[IN] how long the call took. -1 if it was not timed
+   *                  (e.g., an asynchronous read)
+   */
+  void readCall(ssize_t bytes, long long nanos);
+  void writeCall(ssize_t bytes, long long nanos);
+
+  /**
+   * count a write that made the file system allocate space for the
+   * file, and an extent reserved (e.g., by fallocate()) before it was
+   * written. a file written within its reserved extents grows without
+   * fragmenting.
+   */
+  void extended();
+  void preallocated();
+
+  /**
+   * @return a copy of the counters
+   */
+  Snapshot snapshot() const;
+
+  /**
+   * @return the current time in nanoseconds, for timing a call
+   */
+  static long long now();
+
+ private:
+  static int bucketOf(long long nanos);
+
+  std::atomic<long long> cacheHits;
+  std::atomic<long long> cacheMisses;
+  std::atomic<long long> readAheadHits;
+  std::atomic<long long> pageReads;
+  std::atomic<long long> pageWrites;
+  std::atomic<long long> bytesRead;
+  std::atomic<long long> bytesWritten;
+  std::atomic<long long> readCalls;
+  std::atomic<long long> writeCalls;
+  std::atomic<long long> readNanos;
+  std::atomic<long long> writeNanos;
+  std::atomic<long long> extensions;
+  std::atomic<long long> preallocations;
+  std::atomic<long long> readLatency[LATENCY_BUCKETS];
+  std::atomic<long long> writeLatency[LATENCY_BUCKETS];
+
+  IOStats* parent;  // the counters of all files. NULL for the totals
+
+  IOStats(const IOStats&);
+  IOStats& operator=(const IOStats&);
+};
+
+#endif // IOSTATS_H
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "PageCodec.h"
+#include <cstring>
+
+int PageCodec::compress(const char* src, int size, char* dst, int capacity)
+{
+  int in = 0;       // next byte of src to encode
+  int out = 0;      // next byte of dst to write
+  int literal = 0;  // start of the pending literal run
+
+  while (in < size) {
+    // how long is the run of bytes equal to src[in]?
+    int run = 1;
+    while (in + run < size && run < MAX_REPEAT && src[in + run] == src[in]) run++;
+
+    if (run < MIN_REPEAT) {
+      in += run;
+      continue;
+    }
+
+    // emit the pending literal run, then the repeat run
+    while (literal < in) {
+      int n = in - literal;
+      if (n > MAX_LITERAL) n = MAX_LITERAL;
+      if (out + 1 + n > capacity) return -1;
+      dst[out++] = (char)(n - 1);
+      memcpy(dst + out, src + literal, n);
+      out += n;
+      literal += n;
+    }
+    if (out + 2 > capacity) return -1;
+    dst[out++] = (char)(0x80 + run - MIN_REPEAT);
+    dst[out++] = src[in];
+    in += run;
+    literal = in;
+  }
+
+  // emit the trailing literal run
+  while (literal < size) {
+    int n = size - literal;
+    if (n > MAX_LITERAL) n = MAX_LITERAL;
+    if (out + 1 + n > capacity) return -1;
+    dst[out++] = (char)(n - 1);
+    memcpy(dst + out, src + literal, n);
+    out += n;
+    literal += n;
+  }
+
+  return out;
+}
+
+bool PageCodec::decompress(const char* src, int length, char* dst, int size)
+{
+  int in = 0;
+  int out = 0;
+
+  while (in < length) {
+    int c = (unsigned char)src[in++];
+    if (c < 0x80) {
+      int n = c + 1;
+      if (in + n > length || out + n > size) return false;
+      memcpy(dst + out, src + in, n);
+      in += n;
+      out += n;
+    } else {
+      int n = c - 0x80 + MIN_REPEAT;
+      if (in >= length || out + n > size) return false;
+      memset(dst + out, src[in++], n);
+      out += n;
+    }
+  }
+
+  return out == size;
+}
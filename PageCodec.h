@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef PAGECODEC_H
+#define PAGECODEC_H
+
+/**
+ * The run-length codec of compressed PageFiles.
+ * A compressed page is a sequence of runs, each starting with a control
+ * byte c:
+ *   c < 0x80:  a literal run. the next (c + 1) bytes are copied as is
+ *   c >= 0x80: a repeat run. the next byte is repeated (c - 0x80 + 3) times
+ * Pages of fixed-size records are mostly NUL padding, which shrinks to
+ * two bytes per 130 bytes of padding. The codec is simple enough to
+ * decode a page much faster than the disk can deliver it.
+ */
+class PageCodec {
+ public:
+  static const int MAX_LITERAL = 128;   // longest literal run
+  static const int MIN_REPEAT = 3;      // shortest repeat run
+  static const int MAX_REPEAT = 130;    // longest repeat run
+
+  /**
+   * compress a page.
+   * @param src[IN] the page
+   * @param size[IN] the page size
+   * @param dst[OUT] the buffer for the compressed page
+   * @param capacity[IN] size of dst in bytes
+   * @return the size of the compressed page.
+   *         -1 if it does not fit in capacity bytes
+   */
+  static int compress(const char* src, int size, char* dst, int capacity);
+
+  /**
+   * decompress a page.
+   * @param src[IN] the compressed page
+   * @param length[IN] the size of the compressed page
+   * @param dst[OUT] the buffer for the page
+   * @param size[IN] the page size
+   * @return true if src decompressed to exactly size bytes
+   */
+  static bool decompress(const char* src, int length, char* dst, int size);
+};
+
+#endif // PAGECODEC_H
@@ -9,38 +9,201 @@
 
 #include "Bruinbase.h"
 #include "PageFile.h"
+#include "BufferPool.h"
+#include "PageReadBatch.h"
+#include "PageCodec.h"
+#include "WriteAheadLog.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <new>
 #include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 using std::string;
 
-int PageFile::readCount = 0;
-int PageFile::writeCount = 0;
-int PageFile::cacheClock = 1;
-struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
+int PageFile::readAheadWindow = PageFile::DEFAULT_READ_AHEAD;
+int PageFile::extentSize = PageFile::DEFAULT_EXTENT;
+
+//
+// the header page at the start of a file. the rest of the page is zero.
+//
+static const char FILE_MAGIC[8] = { 'B', 'R', 'U', 'I', 'N', 'P', 'G', 'F' };
+
+struct FileHeader {
+  char magic[8];   // FILE_MAGIC
+  int  pageSize;   // the page size of the file
+  int  format;     // FORMAT_* flags of the file
+  long long mapOffset; // offset of the page map of a compressed file
+  int  mapPages;   // # pages in the page map
+  int  layout;     // the layout tag of the user of the file
+};
+
+static const int FORMAT_COMPRESSED = 0x1;  // the pages are compressed
+
+// the extent of a compressed page is allocated in units of
+// (page size / EXTENT_UNITS) bytes, so that a page that grows a little
+// on every write (e.g., the last page of a table) does not have to
+// move to a new extent every time
+static const int EXTENT_UNITS = 16;
+
+// two runs of changed bytes in a page closer than this are logged in
+// one log record, which saves the header of the second record
+static const int LOG_GAP = 48;
+
+// the buffer used by DIRECT I/O of a page in an unaligned buffer
+alignas(PageFile::IO_ALIGNMENT) static thread_local char bounce[PageFile::MAX_PAGE_SIZE];
+
+//
+// every unix file opened by a PageFile is assigned a file id, which
+// identifies its pages in the buffer pool. the cached pages survive
+// close(), so a table or index opened again by the next query is still
+// warm. the size and modification time recorded at close tell us
+// whether the file was changed behind our back in the meantime.
+// the registry also keeps the I/O counters of every file, so that they
+// add up over all the queries that used the file.
+//
+struct FileEntry {
+  int    fid;       // the file id
+  off_t  size;      // file size when the file was last closed
+  struct timespec mtime; // modification time when the file was last closed
+  std::string name; // the name the file was last opened with
+  IOStats stats;    // the I/O counters of the file
+};
+
+// the I/O counters of all files together
+static IOStats totalStats;
+
+static std::mutex fileLatch;
+static std::map<std::pair<dev_t, ino_t>, FileEntry> fileRegistry;
+static int nextFileId = 0;
+
+// get the registry entry of an opened file. the entry is never removed,
+// so the reference stays valid
+static FileEntry& lookupFile(const struct stat& statbuf, const string& name)
+{
+  std::lock_guard<std::mutex> guard(fileLatch);
+  std::pair<dev_t, ino_t> key(statbuf.st_dev, statbuf.st_ino);
+
+  std::map<std::pair<dev_t, ino_t>, FileEntry>::iterator it = fileRegistry.find(key);
+  if (it == fileRegistry.end()) {
+    FileEntry& e = fileRegistry[key];
+    e.fid = nextFileId++;
+    e.size = statbuf.st_size;
+    e.mtime = statbuf.st_mtim;
+    e.name = name;
+    e.stats.setParent(&totalStats);
+    return e;
+  }
+
+  // if the file was modified since we closed it, the cached pages are stale
+  FileEntry& e = it->second;
+  if (e.size != statbuf.st_size ||
+      e.mtime.tv_sec != statbuf.st_mtim.tv_sec ||
+      e.mtime.tv_nsec != statbuf.st_mtim.tv_nsec) {
+    BufferPool::global().invalidateFile(e.fid);
+    e.fid = nextFileId++;
+  }
+  e.name = name;
+  return e;
+}
+
+// remember the state of a file that is about to be closed
+static void recordClose(int fd)
+{
+  struct stat statbuf;
+  if (::fstat(fd, &statbuf) < 0) return;
+
+  std::lock_guard<std::mutex> guard(fileLatch);
+  std::pair<dev_t, ino_t> key(statbuf.st_dev, statbuf.st_ino);
+
+  std::map<std::pair<dev_t, ino_t>, FileEntry>::iterator it = fileRegistry.find(key);
+  if (it == fileRegistry.end()) return;
+  it->second.size = statbuf.st_size;
+  it->second.mtime = statbuf.st_mtim;
+}
 
 PageFile::PageFile() 
 { 
   fd = -1; 
   epid = 0; 
+  fid = -1;
+  stats = NULL;
+  flags = 0;
+  writable = false;
+  direct = false;
+  pageSize = PAGE_SIZE;
+  base = 0;
+  layout = 0;
+  map = NULL;
+  mapPages = 0;
+  compressed = false;
+  dataEnd = 0;
+  mapDirty = false;
+  allocEnd = 0;
+  reserved = 0;
+  preallocating = true;
+  lastRead = -2;
+  seqRun = 0;
+  aheadEnd = 0;
+  lastLsn = 0;
+  pthread_rwlock_init(&mapLatch, NULL);
 }
 
-PageFile::PageFile(const string& filename, char mode)
+PageFile::PageFile(const string& filename, char mode, int flags, int pageSize, int layout)
 {
   fd = -1;
   epid = 0;
-  open(filename.c_str(), mode);
+  fid = -1;
+  stats = NULL;
+  this->flags = 0;
+  writable = false;
+  direct = false;
+  this->pageSize = PAGE_SIZE;
+  base = 0;
+  this->layout = 0;
+  map = NULL;
+  mapPages = 0;
+  compressed = false;
+  dataEnd = 0;
+  mapDirty = false;
+  allocEnd = 0;
+  reserved = 0;
+  preallocating = true;
+  lastRead = -2;
+  seqRun = 0;
+  aheadEnd = 0;
+  lastLsn = 0;
+  pthread_rwlock_init(&mapLatch, NULL);
+  open(filename.c_str(), mode, flags, pageSize, layout);
 }
 
-RC PageFile::open(const string& filename, char mode)
+PageFile::~PageFile()
+{
+  // make sure that no dirty page of this file is left behind
+  if (fd > 0) close();
+  pthread_rwlock_destroy(&mapLatch);
+}
+
+RC PageFile::open(const string& filename, char mode, int flags, int pageSize, int layout)
 {
   RC   rc;
   int  oflag;
   struct stat statbuf;
+  FileHeader header;
 
   if (fd > 0) return RC_FILE_OPEN_FAILED;
+  if ((flags & MMAP) && (flags & (WRITE_BACK|DIRECT|LOGGED))) return RC_INVALID_FILE_MODE;
+  if (!isValidPageSize(pageSize)) return RC_INVALID_PAGE_SIZE;
 
   // set the unix file flag depending on the file mode
   switch (mode) {
@@ -56,6 +219,11 @@ RC PageFile::open(const string& filename, char mode)
     return RC_INVALID_FILE_MODE;
   }
 
+  // a file opened for reading has no writes to log
+  if (oflag == O_RDONLY) flags &= ~LOGGED;
+  if ((flags & LOGGED) && !WriteAheadLog::global().isOpen()) return RC_INVALID_FILE_MODE;
+  if (flags & LOGGED) flags |= WRITE_BACK;
+
   // open the file
   fd = ::open(filename.c_str(), oflag, 0644);
   if (fd < 0) { fd = -1; return RC_FILE_OPEN_FAILED; }
@@ -63,71 +231,439 @@ RC PageFile::open(const string& filename, char mode)
   // get the size of the file to set the end pid
   rc = ::fstat(fd, &statbuf);
   if (rc < 0) { ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED; }
-  epid = statbuf.st_size / PAGE_SIZE;
+
+  // a new file starts with a header page that records its page size
+  if (statbuf.st_size == 0 && oflag != O_RDONLY) {
+    std::vector<char> page(pageSize, 0);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.pageSize = pageSize;
+    header.format = (flags & COMPRESS) ? FORMAT_COMPRESSED : 0;
+    header.layout = layout;
+    memcpy(&page[0], &header, sizeof(header));
+    if (::pwrite(fd, &page[0], pageSize, 0) != pageSize ||
+        ::fstat(fd, &statbuf) < 0) {
+      ::close(fd); fd = -1; return RC_FILE_WRITE_FAILED;
+    }
+  }
+
+  // read the page size from the header. a file without the header
+  // consists of 1KB pages from offset 0
+  this->pageSize = PAGE_SIZE;
+  this->layout = 0;
+  base = 0;
+  compressed = false;
+  if (statbuf.st_size >= (off_t)sizeof(header)) {
+    if (::pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+      ::close(fd); fd = -1; return RC_FILE_READ_FAILED;
+    }
+    if (memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0) {
+      if (!isValidPageSize(header.pageSize)) {
+        ::close(fd); fd = -1; return RC_INVALID_FILE_FORMAT;
+      }
+      this->pageSize = header.pageSize;
+      this->layout = header.layout;
+      base = header.pageSize;
+      compressed = (header.format & FORMAT_COMPRESSED) != 0;
+    }
+  }
+  epid = (statbuf.st_size - base) / this->pageSize;
+
+  // load the page map of a compressed file. new extents go after
+  // everything in the file, so the page map on disk stays intact until
+  // a new one replaces it
+  if (compressed) {
+    size_t size = (size_t)header.mapPages * sizeof(Extent);
+    extents.resize(header.mapPages);
+    if (size > 0 && ::pread(fd, &extents[0], size, header.mapOffset) != (ssize_t)size) {
+      extents.clear();
+      ::close(fd); fd = -1; return RC_INVALID_FILE_FORMAT;
+    }
+    epid = header.mapPages;
+    dataEnd = statbuf.st_size;
+    mapDirty = false;
+    flags &= ~(MMAP|DIRECT);
+  }
+
+  // bypass the kernel page cache from now on. the header was read and
+  // written through it. if the file system does not support O_DIRECT,
+  // the file is used through the page cache
+  if (flags & DIRECT) {
+    int fl = ::fcntl(fd, F_GETFL);
+    direct = (fl >= 0 && ::fcntl(fd, F_SETFL, fl | O_DIRECT) >= 0);
+  }
+
+  // get the id that identifies the pages of the file in the buffer pool
+  FileEntry& entry = lookupFile(statbuf, filename);
+  fid = entry.fid;
+  stats = &entry.stats;
+
+  this->flags = flags;
+  writable = (oflag != O_RDONLY);
+  allocEnd = (PageId)epid;
+  reserved = (PageId)epid;
+  preallocating = true;
+  lastRead = -2;
+  seqRun = 0;
+  aheadEnd = 0;
+  lastLsn = 0;
+
+  // the log names a file by its absolute path, which does not depend
+  // on the working directory of the process that replays the log
+  if (flags & LOGGED) {
+    char* p = ::realpath(filename.c_str(), NULL);
+    path = (p != NULL) ? p : filename;
+    ::free(p);
+    WriteAheadLog::global().addFile(this);
+  }
+
+  // map the existing pages of the file
+  if ((flags & MMAP) && epid > 0) {
+    void* addr = ::mmap(NULL, (size_t)offsetOf(epid),
+                        writable ? (PROT_READ|PROT_WRITE) : PROT_READ,
+                        MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) { ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED; }
+    map = (char*)addr;
+    mapPages = epid;
+  }
 
   return 0;
 }
 
 RC PageFile::close()
 {
+  RC rc;
+
   if (fd <= 0) return RC_FILE_CLOSE_FAILED;
 
-  // close the file
-  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
+  // write the dirty pages of the file to disk
+  if ((rc = flush()) < 0) return rc;
+
+  // unmap the file and cut off the pages that were mapped in advance
+  if (map != NULL) {
+    ::munmap(map, (size_t)offsetOf(mapPages));
+    if (mapPages > epid && ::ftruncate(fd, offsetOf(epid)) < 0) {
+      return RC_FILE_CLOSE_FAILED;
+    }
+    map = NULL;
+    mapPages = 0;
+  }
 
-  // evict all cached pages for this file
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
+  // give back the disk space reserved beyond the last page
+  if (reserved > epid && !compressed) {
+    struct stat statbuf;
+    if (::fstat(fd, &statbuf) < 0 || ::ftruncate(fd, statbuf.st_size) < 0) {
+      return RC_FILE_CLOSE_FAILED;
     }
   }
 
+  // the cached pages of the file stay in the buffer pool.
+  // record the file state so that we can tell if they are still valid
+  // when the file is opened again.
+  recordClose(fd);
+
+  // the pages written back are fsynced by the next checkpoint, which
+  // must not empty the log before they are on disk
+  if (flags & LOGGED) WriteAheadLog::global().removeFile(this, ::dup(fd));
+
+  // close the file
+  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
+
   // set the fd and epid to the initial state
   fd = -1; 
   epid = 0;
+  fid = -1;
+  stats = NULL;
+  flags = 0;
+  writable = false;
+  direct = false;
+  pageSize = PAGE_SIZE;
+  base = 0;
+  layout = 0;
+  compressed = false;
+  extents.clear();
+  dataEnd = 0;
+  allocEnd = 0;
+  reserved = 0;
+  path.clear();
+  pageLsn.clear();
   return 0;
 }
 
+RC PageFile::flush()
+{
+  RC rc;
+  if ((flags & WRITE_BACK) && (rc = BufferPool::global().flushFile(fid, this)) < 0) return rc;
+  return writePageMap();
+}
+
+RC PageFile::sync()
+{
+  RC rc;
+
+  if (fd <= 0) return RC_FILE_WRITE_FAILED;
+  if ((rc = flush()) < 0) return rc;
+  if (!writable) return 0;
+  if (map != NULL) {
+    pthread_rwlock_rdlock(&mapLatch);
+    int r = ::msync(map, (size_t)offsetOf(mapPages), MS_SYNC);
+    pthread_rwlock_unlock(&mapLatch);
+    if (r < 0) return RC_FILE_WRITE_FAILED;
+    return 0;
+  }
+  return (::fdatasync(fd) < 0) ? RC_FILE_WRITE_FAILED : 0;
+}
+
+RC PageFile::commit()
+{
+  if (fd <= 0) return RC_FILE_WRITE_FAILED;
+  if (flags & LOGGED) return WriteAheadLog::global().commit(lastLsn);
+  return sync();
+}
+
 PageId PageFile::endPid() const 
 {
   return epid;
 }
 
-RC PageFile::seek(PageId pid) const
+RC PageFile::writePage(PageId pid, const void* buffer)
+{
+  RC rc;
+
+  // the log records of the page must be on disk before the page is
+  if (flags & LOGGED) {
+    Lsn lsn = 0;
+    {
+      std::lock_guard<std::mutex> lock(lsnLatch);
+      std::unordered_map<PageId, Lsn>::const_iterator it = pageLsn.find(pid);
+      if (it != pageLsn.end()) lsn = it->second;
+    }
+    if ((rc = WriteAheadLog::global().flush(lsn)) < 0) return rc;
+  }
+
+  // write the buffer to the disk page
+  if (compressed) {
+    if ((rc = writeCompressed(pid, buffer)) < 0) return rc;
+  } else {
+    // a page beyond the reserved space makes the file system allocate
+    // space for it on the spot
+    PageId end = reserved;
+    if (pid >= end) {
+      stats->extended();
+      while (pid >= end && !reserved.compare_exchange_weak(end, pid + 1)) ;
+    }
+    if (writeAt(buffer, pageSize, offsetOf(pid)) != pageSize) {
+      return RC_FILE_WRITE_FAILED;
+    }
+  }
+
+  // increase page write count
+  stats->pagesWritten(1);
+
+  return 0;
+}
+
+RC PageFile::allocate(int count, PageId& first)
+{
+  if (count <= 0) return RC_INVALID_PID;
+  if (!writable) return RC_FILE_WRITE_FAILED;
+
+  // the pages come after both the written and the reserved pages
+  PageId end = allocEnd;
+  for (;;) {
+    first = (end > epid) ? end : (PageId)epid;
+    if (allocEnd.compare_exchange_weak(end, first + count)) break;
+  }
+
+  preallocate(first + count);
+  return 0;
+}
+
+void PageFile::preallocate(PageId end)
+{
+  if (end <= reserved || compressed || (flags & MMAP) || extentSize <= 0) return;
+
+  std::lock_guard<std::mutex> guard(allocLatch);
+  PageId from = reserved;
+  if (end <= from || !preallocating) return;
+
+  // reserve at least an extent, and an eighth of the file, so that a
+  // file grows in O(log n) steps. the file size does not change until
+  // the pages are written
+  PageId to = from + ((from / 8 > extentSize) ? from / 8 : extentSize);
+  if (to < end) to = end;
+  if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, offsetOf(from),
+                  (off_t)(to - from) * pageSize) < 0) {
+    // the file system cannot reserve space. the writes grow the file
+    preallocating = false;
+    return;
+  }
+  stats->preallocated();
+  while (to > from && !reserved.compare_exchange_weak(from, to)) ;
+}
+
+int PageFile::countDiskExtents(const string& filename)
+{
+  struct fiemap fm;
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return -1;
+
+  // with no room for the extents, FIEMAP only counts them
+  memset(&fm, 0, sizeof(fm));
+  fm.fm_start = 0;
+  fm.fm_length = FIEMAP_MAX_OFFSET;
+  fm.fm_flags = FIEMAP_FLAG_SYNC;
+  fm.fm_extent_count = 0;
+  int rc = ::ioctl(fd, FS_IOC_FIEMAP, &fm);
+  ::close(fd);
+
+  return (rc < 0) ? -1 : (int)fm.fm_mapped_extents;
+}
+
+RC PageFile::growMapping(PageId pid)
 {
-  return (::lseek(fd, pid * PAGE_SIZE, SEEK_SET) < 0) ? RC_FILE_SEEK_FAILED : 0;
+  // readers must not use the mapping while it moves
+  pthread_rwlock_wrlock(&mapLatch);
+  if (pid < mapPages) {
+    // another thread has grown the mapping in the meantime
+    pthread_rwlock_unlock(&mapLatch);
+    return 0;
+  }
+
+  // grow the file at least by a half to make the remapping infrequent
+  PageId pages = mapPages + mapPages / 2;
+  if (pages < pid + 1) pages = pid + 1;
+  if (pages < 64) pages = 64;
+
+  if (::ftruncate(fd, offsetOf(pages)) < 0) {
+    pthread_rwlock_unlock(&mapLatch);
+    return RC_FILE_WRITE_FAILED;
+  }
+
+  void* addr;
+  if (map == NULL) {
+    addr = ::mmap(NULL, (size_t)offsetOf(pages), PROT_READ|PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+  } else {
+    addr = ::mremap(map, (size_t)offsetOf(mapPages),
+                    (size_t)offsetOf(pages), MREMAP_MAYMOVE);
+  }
+  if (addr == MAP_FAILED) {
+    pthread_rwlock_unlock(&mapLatch);
+    return RC_FILE_WRITE_FAILED;
+  }
+
+  map = (char*)addr;
+  mapPages = pages;
+  pthread_rwlock_unlock(&mapLatch);
+  return 0;
 }
 
 RC PageFile::write(PageId pid, const void* buffer)
 {
   RC rc;
   if (pid < 0) return RC_INVALID_PID; 
+  if (!writable) return RC_FILE_WRITE_FAILED;
 
-  // seek to the location of the page
-  if ((rc = seek(pid)) < 0) return rc;
+  if (flags & MMAP) {
+    // store the page in the mapping. the kernel writes it to disk
+    if ((rc = growMapping(pid)) < 0) return rc;
+    pthread_rwlock_rdlock(&mapLatch);
+    memcpy(map + offsetOf(pid), buffer, pageSize);
+    pthread_rwlock_unlock(&mapLatch);
+    stats->pagesWritten(1);
 
-  // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+    // a copy cached while the file was opened without MMAP is stale now
+    BufferPool::global().invalidate(fid, pid);
+  } else if (flags & LOGGED) {
+    if ((rc = logWrite(pid, buffer)) < 0) return rc;
+  } else if (flags & WRITE_BACK) {
+    // reserve the disk space of the page now. the pages are written
+    // back in any order, and they are laid out on disk in page order
+    preallocate(pid + 1);
 
-  // if the page is in read cache, invalidate it
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid &&
-        readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
-       break;
-    }
+    // keep the page in the buffer pool as a dirty page.
+    // it reaches the disk when it is evicted or flushed
+    if ((rc = BufferPool::global().put(fid, pid, buffer, pageSize, this)) < 0) return rc;
+  } else {
+    // write the page to disk and refresh the cached copy, so that
+    // reading the page back does not go to the disk again
+    preallocate(pid + 1);
+    if ((rc = writePage(pid, buffer)) < 0) return rc;
+    if ((rc = BufferPool::global().put(fid, pid, buffer, pageSize)) < 0) return rc;
   }
 
   // if the written pid >= end pid, update the end pid
-  if (pid >= epid) epid = pid + 1;
+  PageId end = epid;
+  while (pid >= end && !epid.compare_exchange_weak(end, pid + 1)) ;
 
-  // increase page write count
-  writeCount++;
+  return 0;
+}
+
+RC PageFile::logWrite(PageId pid, const void* buffer)
+{
+  RC rc = 0;
+  WriteAheadLog& wal = WriteAheadLog::global();
+  const char* page = (const char*)buffer;
+  static const char zeros[MAX_PAGE_SIZE] = { 0 };
+
+  // log only the bytes that changed since the cached version. a page
+  // beyond the end of the file was zeros. any other page that is not
+  // cached is logged whole
+  const char* old = NULL;
+  PageGuard guard;
+  if (BufferPool::global().pin(fid, pid, guard)) {
+    old = guard.data();
+  } else if (pid >= epid) {
+    old = zeros;
+  }
+
+  // the runs of changed bytes. runs closer than a log record header
+  // are logged together
+  std::vector<std::pair<int, int> > runs;
+  if (old == NULL) {
+    runs.push_back(std::make_pair(0, pageSize));
+  } else {
+    int i = 0;
+    while (i < pageSize) {
+      while (i < pageSize && old[i] == page[i]) i++;
+      if (i == pageSize) break;
+      int first = i;
+      int last = i + 1;
+      for (i++; i < pageSize && i - last < LOG_GAP; i++) {
+        if (old[i] != page[i]) last = i + 1;
+      }
+      runs.push_back(std::make_pair(first, last));
+      i = last;
+    }
+  }
+  guard.release();
+  if (runs.empty()) return 0;
 
+  preallocate(pid + 1);
+
+  // a checkpoint cannot empty the log between the log records and the
+  // dirty page, which would leave the write in neither place
+  Lsn lsn = 0;
+  wal.beginWrite();
+  for (unsigned i = 0; i < runs.size() && rc == 0; i++) {
+    int first = runs[i].first;
+    rc = wal.append(path, pid, pageSize, first, page + first, runs[i].second - first, lsn);
+  }
+  if (rc == 0) {
+    {
+      std::lock_guard<std::mutex> lock(lsnLatch);
+      pageLsn[pid] = lsn;
+    }
+    long long prev = lastLsn;
+    while (lsn > prev && !lastLsn.compare_exchange_weak(prev, lsn)) ;
+    rc = BufferPool::global().put(fid, pid, buffer, pageSize, this);
+  }
+  wal.endWrite();
+  if (rc < 0) return rc;
+
+  if (wal.needsCheckpoint()) return wal.checkpoint();
   return 0;
 }
 
@@ -137,44 +673,451 @@ RC PageFile::read(PageId pid, void* buffer) const
 
   if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
 
-  //
-  // if the page is in cache, read it from there
-  //
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid && 
-        readCache[i].lastAccessed != 0) {
-       memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
-       readCache[i].lastAccessed = ++cacheClock;
-       return 0;
+  // in MMAP mode, the page is copied straight from the mapping
+  if (flags & MMAP) {
+    pthread_rwlock_rdlock(&mapLatch);
+    memcpy(buffer, map + offsetOf(pid), pageSize);
+    pthread_rwlock_unlock(&mapLatch);
+    stats->pagesRead(1);
+    return 0;
+  }
+
+  // if the page is in the buffer pool, read it from there
+  bool ahead = false;
+  if (BufferPool::global().get(fid, pid, buffer, &ahead)) {
+    stats->hit(ahead);
+    readAhead(pid);
+    return 0;
+  }
+  stats->miss();
+
+  // read the page from disk
+  if ((rc = readPage(pid, buffer)) < 0) return rc;
+
+  // keep a copy of it in the buffer pool. if another thread has cached
+  // the page in the meantime, its copy is the more recent one
+  if ((rc = BufferPool::global().fill(fid, pid, buffer, pageSize)) < 0) return rc;
+
+  // increase the page read count
+  stats->pagesRead(1);
+
+  readAhead(pid);
+  return 0;
+}
+
+RC PageFile::pin(PageId pid, PageGuard& guard) const
+{
+  RC   rc;
+  char page[MAX_PAGE_SIZE];
+
+  guard.release();
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID;
+
+  // the mapping may move, so the guard gets a copy of the page
+  if (flags & MMAP) {
+    guard.copy.resize(pageSize);
+    if ((rc = read(pid, &guard.copy[0])) < 0) return rc;
+    guard.page = &guard.copy[0];
+    guard.pid = pid;
+    return 0;
+  }
+
+  // if the page is in the buffer pool, pin it there
+  bool ahead = false;
+  if (BufferPool::global().pin(fid, pid, guard, &ahead)) {
+    stats->hit(ahead);
+    readAhead(pid);
+    return 0;
+  }
+  stats->miss();
+
+  // read the page and pin it as it enters the buffer pool
+  if ((rc = readPage(pid, page)) < 0) return rc;
+  if ((rc = BufferPool::global().fill(fid, pid, page, pageSize, &guard)) < 0) return rc;
+
+  // increase the page read count
+  stats->pagesRead(1);
+
+  readAhead(pid);
+  return 0;
+}
+
+void PageFile::readAhead(PageId pid) const
+{
+  // is the file being read sequentially? reading the same page
+  // again (e.g., the next record in the page) does not break a run
+  PageId prev = lastRead.exchange(pid);
+  if (pid == prev) return;
+  if (pid != prev + 1) {
+    seqRun = 0;
+    return;
+  }
+  if (++seqRun < SEQUENTIAL_RUN || readAheadWindow <= 0) return;
+
+  // nothing to do while the scan is inside the window read before
+  PageId first = pid + 1;
+  if (first < aheadEnd) return;
+
+  PageId last = pid + readAheadWindow;
+  if (last >= epid) last = epid - 1;
+  if (first > last) return;
+  PageId end = last + 1;
+
+  // the pages at either end of the window that the pool holds already
+  // are not read again. a window that is all cached reads nothing
+  BufferPool& pool = BufferPool::global();
+  while (first <= last && pool.contains(fid, first)) first++;
+  while (last >= first && pool.contains(fid, last)) last--;
+  if (first > last) {
+    aheadEnd = end;
+    return;
+  }
+
+  // read the rest of the window with one disk read
+  int count = last - first + 1;
+  int stored = 0;
+  if (compressed) {
+    int done = readAheadCompressed(first, count, stored);
+    stats->pagesRead(stored);
+    if (done < count) return;
+    aheadEnd = end;
+    return;
+  }
+
+  // a page of the window written back from the pool after the read
+  // is not stored from the read (see BufferPool::prefetch())
+  unsigned long long writes = BufferPool::global().getWriteCount();
+  size_t size = (size_t)count * pageSize;
+  char* pages = allocBuffer(size);
+  ssize_t n = readAt(pages, size, offsetOf(first));
+  if (n < 0) { freeBuffer(pages); return; }
+  if (n < (ssize_t)size) memset(pages + n, 0, size - n);
+
+  // only the pages stored in the pool count as read. the others were
+  // cached or written after the read
+  int i;
+  for (i = 0; i < count; i++) {
+    bool s;
+    if (pool.prefetch(fid, first + i, pages + (size_t)i * pageSize, pageSize, writes, &s) < 0) break;
+    if (s) stored++;
+  }
+  freeBuffer(pages);
+  stats->pagesRead(stored);
+  if (i < count) return;
+  aheadEnd = end;
+
+  // let the kernel fetch the window after this one in the background.
+  // in DIRECT mode, there is no page cache to fetch into
+  if (!direct) {
+    ::posix_fadvise(fd, offsetOf(end),
+                    (off_t)readAheadWindow * pageSize, POSIX_FADV_WILLNEED);
+  }
+}
+
+RC PageFile::readPage(PageId pid, void* buffer) const
+{
+  if (compressed) return readCompressed(pid, buffer);
+
+  // the part of the page beyond the end of the unix file
+  // (a page not yet written back) reads as zeros
+  ssize_t n = readAt(buffer, pageSize, offsetOf(pid));
+  if (n < 0) return RC_FILE_READ_FAILED;
+  if (n < pageSize) memset((char*)buffer + n, 0, pageSize - n);
+  return 0;
+}
+
+RC PageFile::writeCompressed(PageId pid, const void* buffer)
+{
+  char packed[MAX_PAGE_SIZE];
+
+  // a page that does not shrink is stored as is
+  const char* data = packed;
+  int length = PageCodec::compress((const char*)buffer, pageSize, packed, pageSize - 1);
+  if (length < 0) {
+    data = (const char*)buffer;
+    length = pageSize;
+  }
+
+  pthread_rwlock_wrlock(&mapLatch);
+  if (pid >= (PageId)extents.size()) {
+    Extent empty = { 0, 0, 0 };
+    extents.resize(pid + 1, empty);
+  }
+
+  // the page moves to a new extent at the end of the file if it has
+  // outgrown its extent. the old extent is left unused
+  Extent& e = extents[pid];
+  if (length > e.capacity) {
+    stats->extended();
+    int unit = pageSize / EXTENT_UNITS;
+    e.offset = dataEnd;
+    e.capacity = (length + unit - 1) / unit * unit;
+    dataEnd += e.capacity;
+  }
+  e.length = length;
+  mapDirty = true;
+
+  // readers of the page wait for the write, since it may be in place
+  ssize_t n = writeAt(data, length, e.offset);
+  pthread_rwlock_unlock(&mapLatch);
+  return (n == length) ? 0 : RC_FILE_WRITE_FAILED;
+}
+
+RC PageFile::readCompressed(PageId pid, void* buffer) const
+{
+  char packed[MAX_PAGE_SIZE];
+  ssize_t n = 0;
+  int length = 0;
+
+  pthread_rwlock_rdlock(&mapLatch);
+  if (pid < (PageId)extents.size() && extents[pid].length > 0) {
+    length = extents[pid].length;
+    n = readAt(packed, length, extents[pid].offset);
+  }
+  pthread_rwlock_unlock(&mapLatch);
+
+  if (n != length) return RC_FILE_READ_FAILED;
+  return unpackPage(packed, length, buffer);
+}
+
+RC PageFile::unpackPage(const char* packed, int length, void* buffer) const
+{
+  // a page not written to disk yet reads as zeros
+  if (length == 0) {
+    memset(buffer, 0, pageSize);
+    return 0;
+  }
+  if (length == pageSize) {
+    memcpy(buffer, packed, pageSize);
+    return 0;
+  }
+  if (!PageCodec::decompress(packed, length, (char*)buffer, pageSize)) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+  return 0;
+}
+
+int PageFile::readAheadCompressed(PageId first, int count, int& stored) const
+{
+  char page[MAX_PAGE_SIZE];
+  std::vector<Extent> window(count);
+
+  // taken before the extents, which a write-back moves
+  unsigned long long writes = BufferPool::global().getWriteCount();
+  pthread_rwlock_rdlock(&mapLatch);
+
+  // find the part of the file that holds the extents of the pages
+  off_t begin = -1;
+  off_t end = 0;
+  for (int i = 0; i < count; i++) {
+    Extent empty = { 0, 0, 0 };
+    window[i] = (first + i < (PageId)extents.size()) ? extents[first + i] : empty;
+    if (window[i].length == 0) continue;
+    if (begin < 0 || window[i].offset < begin) begin = window[i].offset;
+    if (window[i].offset + window[i].length > end) end = window[i].offset + window[i].length;
+  }
+
+  // the pages were written one after another, unless they were rewritten
+  // later. do not read a large part of the file for a few pages
+  if (begin < 0 || end - begin > (off_t)count * pageSize) {
+    pthread_rwlock_unlock(&mapLatch);
+    return 0;
+  }
+
+  char* packed = allocBuffer(end - begin);
+  ssize_t n = readAt(packed, end - begin, begin);
+  pthread_rwlock_unlock(&mapLatch);
+  if (n != end - begin) { freeBuffer(packed); return 0; }
+
+  int i;
+  for (i = 0; i < count; i++) {
+    const char* extent = (window[i].length > 0) ? packed + (window[i].offset - begin) : NULL;
+    bool s;
+    if (unpackPage(extent, window[i].length, page) < 0) break;
+    if (BufferPool::global().prefetch(fid, first + i, page, pageSize, writes, &s) < 0) break;
+    if (s) stored++;
+  }
+  freeBuffer(packed);
+  return i;
+}
+
+RC PageFile::writePageMap()
+{
+  FileHeader header;
+
+  if (!compressed) return 0;
+
+  // the new page map goes to the end of the file. the header points to
+  // the old one until the new one is complete
+  pthread_rwlock_wrlock(&mapLatch);
+  if (!mapDirty) {
+    pthread_rwlock_unlock(&mapLatch);
+    return 0;
+  }
+  size_t size = extents.size() * sizeof(Extent);
+  off_t offset = dataEnd;
+  if (size > 0 && writeAt(&extents[0], size, offset) != (ssize_t)size) {
+    pthread_rwlock_unlock(&mapLatch);
+    return RC_FILE_WRITE_FAILED;
+  }
+  dataEnd += size;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+  header.pageSize = pageSize;
+  header.format = FORMAT_COMPRESSED;
+  header.mapOffset = offset;
+  header.mapPages = extents.size();
+  header.layout = layout;
+  if (writeAt(&header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+    pthread_rwlock_unlock(&mapLatch);
+    return RC_FILE_WRITE_FAILED;
+  }
+  mapDirty = false;
+  pthread_rwlock_unlock(&mapLatch);
+  return 0;
+}
+
+ssize_t PageFile::readAt(void* buffer, size_t size, off_t offset) const
+{
+  for (;;) {
+    ssize_t n;
+    long long start = IOStats::now();
+    if (!direct) {
+      n = ::pread(fd, buffer, size, offset);
+      stats->readCall(n, IOStats::now() - start);
+      return n;
+    }
+
+    if ((uintptr_t)buffer % IO_ALIGNMENT == 0) {
+      n = ::pread(fd, buffer, size, offset);
+    } else {
+      n = ::pread(fd, bounce, size, offset);
+      if (n > 0) memcpy(buffer, bounce, n);
     }
+    stats->readCall(n, IOStats::now() - start);
+    if (n >= 0 || errno != EINVAL) return n;
+
+    // the file system cannot do direct I/O in units of this page size
+    disableDirect();
   }
+}
 
-  // seek to the page
-  if ((rc = seek(pid)) < 0) return rc;
-  
-  // find the cache slot to evict
-  int toEvict = 0; 
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].lastAccessed == 0) {
-      toEvict = i;
-      break;
+ssize_t PageFile::writeAt(const void* buffer, size_t size, off_t offset)
+{
+  for (;;) {
+    ssize_t n;
+    long long start = IOStats::now();
+    if (!direct) {
+      n = ::pwrite(fd, buffer, size, offset);
+      stats->writeCall(n, IOStats::now() - start);
+      return n;
     }
-    if (readCache[i].lastAccessed < readCache[toEvict].lastAccessed) {
-      toEvict = i;
+
+    if ((uintptr_t)buffer % IO_ALIGNMENT == 0) {
+      n = ::pwrite(fd, buffer, size, offset);
+    } else {
+      memcpy(bounce, buffer, size);
+      n = ::pwrite(fd, bounce, size, offset);
     }
+    stats->writeCall(n, IOStats::now() - start);
+    if (n >= 0 || errno != EINVAL) return n;
+
+    // the file system cannot do direct I/O in units of this page size
+    disableDirect();
+  }
+}
+
+void PageFile::disableDirect() const
+{
+  int fl = ::fcntl(fd, F_GETFL);
+  if (fl >= 0) ::fcntl(fd, F_SETFL, fl & ~O_DIRECT);
+  direct = false;
+}
+
+IOStats::Snapshot PageFile::getIOStats() const
+{
+  return (stats == NULL) ? IOStats::Snapshot() : stats->snapshot();
+}
+
+static bool byName(const PageFile::FileStats& a, const PageFile::FileStats& b)
+{
+  return a.name < b.name;
+}
+
+void PageFile::getAllIOStats(std::vector<FileStats>& files)
+{
+  std::lock_guard<std::mutex> guard(fileLatch);
+  files.clear();
+  std::map<std::pair<dev_t, ino_t>, FileEntry>::const_iterator it;
+  for (it = fileRegistry.begin(); it != fileRegistry.end(); ++it) {
+    FileStats f;
+    f.name = it->second.name;
+    f.dev = it->first.first;
+    f.ino = it->first.second;
+    f.stats = it->second.stats.snapshot();
+    files.push_back(f);
   }
-  readCache[toEvict].fd = fd;
-  readCache[toEvict].pid = pid;
-  readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
-    return RC_FILE_READ_FAILED;
+  std::sort(files.begin(), files.end(), byName);
+}
+
+IOStats::Snapshot PageFile::getTotalIOStats()
+{
+  return totalStats.snapshot();
+}
+
+long long PageFile::getPageReadCount()
+{
+  return totalStats.snapshot().pageReads;
+}
+
+long long PageFile::getPageWriteCount()
+{
+  return totalStats.snapshot().pageWrites;
+}
+
+long long PageFile::getReadAheadHitCount()
+{
+  return totalStats.snapshot().readAheadHits;
+}
+
+char* PageFile::allocBuffer(size_t size)
+{
+  void* buffer;
+  if (::posix_memalign(&buffer, IO_ALIGNMENT, size) != 0) throw std::bad_alloc();
+  return (char*)buffer;
+}
+
+void PageFile::freeBuffer(char* buffer)
+{
+  ::free(buffer);
+}
+
+RC PageFile::readAsync(const std::vector<PageId>& pids, PageReadBatch& batch) const
+{
+  RC   rc;
+  char page[MAX_PAGE_SIZE];
+
+  for (unsigned i = 0; i < pids.size(); i++) {
+    if (pids[i] < 0 || pids[i] >= epid) return RC_INVALID_PID;
   }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
 
-  // increase the page read count
-  readCount++;
+  batch.reset(this, fd, pids.size());
+  for (unsigned i = 0; i < pids.size(); i++) {
+    if ((flags & MMAP) || compressed) {
+      // nothing to wait for in MMAP mode. the extent of a compressed
+      // page is read with the page map latched, so it is read right away
+      if ((rc = read(pids[i], page)) < 0) return rc;
+      batch.addReady(pids[i], page);
+    } else if (BufferPool::global().get(fid, pids[i], page)) {
+      stats->hit(false);
+      batch.addReady(pids[i], page);
+    } else {
+      stats->miss();
+      batch.addRead(pids[i]);
+    }
+  }
+  batch.submit();
 
   return 0;
 }
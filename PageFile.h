@@ -10,55 +10,172 @@
 #ifndef PAGEFILE_H
 #define PAGEFILE_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
 #include "Bruinbase.h"
+#include "IOStats.h"
 
 typedef int PageId;
 
+class BufferPool;
+class PageGuard;
+class PageReadBatch;
+
 /**
- * read/write a file in the unit of a page
+ * read/write a file in the unit of a page.
+ * the page size of a file is chosen when the file is created and is
+ * recorded in a header page at the start of the file. page 0 is the
+ * first page after the header. a file without the header (written by
+ * an older version of Bruinbase) is read as a file of 1KB pages.
+ * the pages of a file created with COMPRESS are stored compressed, each
+ * in an extent of its own, and a page map records where every page is.
+ * all I/O is positional (pread/pwrite), so several threads can read
+ * pages of the same PageFile at the same time.
  */
 class PageFile {
  public:
 
-  static const int PAGE_SIZE = 1024;    // the size of a page is 1KB
+  static const int PAGE_SIZE = 1024;    // the default page size is 1KB
+  static const int MAX_PAGE_SIZE = 65536; // the largest page size is 64KB
+
+  static const int DEFAULT_READ_AHEAD = 32;  // default read-ahead window
+  static const int SEQUENTIAL_RUN = 2;  // # of consecutive page reads
+                                        // that start read-ahead
+  static const int DEFAULT_EXTENT = 64; // min # pages of disk space
+                                        // reserved when a file grows
+
+  //
+  // option flags for open()
+  //
+  // write() only updates the page in the buffer pool. the dirty page is
+  // written to disk when it is evicted, or by flush() or close().
+  static const int WRITE_BACK = 0x1;
+  // the file is mapped into memory. read() copies the page straight from
+  // the mapping and write() stores it there, leaving the caching to the
+  // kernel page cache. cannot be combined with WRITE_BACK or DIRECT.
+  static const int MMAP       = 0x2;
+  // the pages are read and written with O_DIRECT, bypassing the kernel
+  // page cache, so that a page is cached once, in the buffer pool. if the
+  // file system does not support O_DIRECT, the page cache is used.
+  static const int DIRECT     = 0x4;
+  // a new file stores its pages compressed (see PageCodec). a page is
+  // compressed when it is written to disk and decompressed when it is
+  // read into the buffer pool. whether an existing file is compressed is
+  // recorded in its header. MMAP and DIRECT do not apply to a compressed
+  // file and are ignored for it.
+  static const int COMPRESS   = 0x8;
+  // a page write is recorded in the WriteAheadLog, which must be open,
+  // and the page stays dirty in the buffer pool as with WRITE_BACK (which
+  // LOGGED implies). commit() makes the writes durable with a log fsync
+  // shared by the commits of a group. cannot be combined with MMAP.
+  static const int LOGGED     = 0x10;
+
+  static const int IO_ALIGNMENT = 4096; // buffer alignment for DIRECT I/O
 
   PageFile();
-  PageFile(const std::string& filename, char mode);
+  PageFile(const std::string& filename, char mode, int flags = 0,
+           int pageSize = PAGE_SIZE, int layout = 0);
+  ~PageFile();
 
   /**
    * open a file in read or write mode.
    * when opened in 'w' mode, if the file does not exist, it is created.
    * @param filename[IN] the name of the file to open
    * @param mode[IN] 'r' for read, 'w' for write
+   * @param flags[IN] option flags (e.g., WRITE_BACK) ORed together
+   * @param pageSize[IN] the page size of the file if it is created.
+   *                     an existing file keeps the page size in its header
+   * @param layout[IN] the layout tag of the file if it is created (see
+   *                   getLayout()). an existing file keeps its tag
    * @return error code. 0 if no error
    */
-  RC open(const std::string& filename, char mode);
+  RC open(const std::string& filename, char mode, int flags = 0,
+          int pageSize = PAGE_SIZE, int layout = 0);
 
   /**
-   * close the file.
+   * close the file. dirty pages of the file are written to disk first.
    * @return error code. 0 if no error
    */
   RC close();
+
+  /**
+   * write all dirty pages of the file to disk.
+   * @return error code. 0 if no error
+   */
+  RC flush();
+
+  /**
+   * write all dirty pages of the file to disk and fsync the file.
+   * @return error code. 0 if no error
+   */
+  RC sync();
+
+  /**
+   * make all writes to the file so far durable. in LOGGED mode, this
+   * waits for the log records of the writes to be fsynced. otherwise,
+   * the file is synced.
+   * @return error code. 0 if no error
+   */
+  RC commit();
   
   /**
    * read a disk page into memory buffer.
    * @param pid[IN] the page to read
-   * @param buffer[OUT] pointer to memory buffer
+   * @param buffer[OUT] pointer to memory buffer of getPageSize() bytes
    * @return error code. 0 if no error
    */
   RC read(PageId pid, void *buffer) const;
+
+  /**
+   * pin a disk page in the buffer pool to read it in place, without
+   * copying it into a buffer of the caller. the page is read from disk
+   * if it is not in the pool. in MMAP mode, the guard holds a copy of
+   * the page, since the mapping may move when the file grows.
+   * @param pid[IN] the page to read
+   * @param guard[OUT] the guard that gives access to the page
+   * @return error code. 0 if no error
+   */
+  RC pin(PageId pid, PageGuard& guard) const;
+
+  /**
+   * read a batch of pages asynchronously. the reads are issued at once
+   * and the pages are returned by batch.next() as they arrive.
+   * pages found in the buffer pool are returned without disk I/O, and
+   * the pages read from disk are added to the buffer pool.
+   * @param pids[IN] the pages to read
+   * @param batch[OUT] the batch that returns the pages
+   * @return error code. 0 if no error
+   */
+  RC readAsync(const std::vector<PageId>& pids, PageReadBatch& batch) const;
   
   /**
    * write the memory buffer to the disk page.
    * if (pid >= endPid()), the file is expanded such that
    * endPid() becomes (pid + 1).
+   * in WRITE_BACK mode, the page is written to disk later.
    * @param pid[IN] page to write to
    * @param buffer[IN] the content to write
    * @return error code. 0 if no error
    */
   RC write(PageId pid, const void *buffer);
     
+  /**
+   * reserve count contiguous pages after the last page of the file, so
+   * that the caller can write them later and keep related pages (e.g.,
+   * the leaves of a B+tree) next to each other. disk space is reserved
+   * for the pages right away. a page reserved but never written reads
+   * as zeros once a later page is written.
+   * @param count[IN] # pages to reserve
+   * @param first[OUT] the first reserved page
+   * @return error code. 0 if no error
+   */
+  RC allocate(int count, PageId& first);
+
   /**
    * note the +1 part. The last page id in the file is actually endPid()-1.
    * that is, the last page can be read by "read(endPid()-1, buffer)".
@@ -67,46 +184,285 @@ class PageFile {
   PageId endPid() const;
 
   /**
-   * @return the total # of disk reads
+   * @return the page size of the file in bytes
+   */
+  int getPageSize() const { return pageSize; }
+
+  /**
+   * @return the layout tag recorded in the header of the file. the tag
+   *         belongs to the user of the file, which tells with it how
+   *         the pages are organized (e.g., the record format of a
+   *         RecordFile). 0 for a file without a header
    */
-  static int getPageReadCount()  { return readCount; }
+  int getLayout() const { return layout; }
+
+  /**
+   * @return true if the pages of the file are stored compressed
+   */
+  bool isCompressed() const { return compressed; }
+
+  /**
+   * @return true if size is a valid page size: a power of two
+   *         between PAGE_SIZE and MAX_PAGE_SIZE
+   */
+  static bool isValidPageSize(int size)
+    { return size >= PAGE_SIZE && size <= MAX_PAGE_SIZE && (size & (size - 1)) == 0; }
+
+  /**
+   * the I/O counters of a file.
+   */
+  struct FileStats {
+    std::string name;         // the name the file was last opened with
+    dev_t dev;                // the device of the file
+    ino_t ino;                // the inode of the file
+    IOStats::Snapshot stats;  // its counters
+  };
+
+  /**
+   * @return the I/O counters of the file. the counters belong to the
+   *         unix file and keep counting across close() and open()
+   */
+  IOStats::Snapshot getIOStats() const;
+
+  /**
+   * get the I/O counters of every file opened by this process.
+   * @param files[OUT] the counters, ordered by file name
+   */
+  static void getAllIOStats(std::vector<FileStats>& files);
+
+  /**
+   * @return the I/O counters of all files together
+   */
+  static IOStats::Snapshot getTotalIOStats();
+
+  /**
+   * @return the total # of pages read from disk
+   */
+  static long long getPageReadCount();
   
   /**
-   * @return the total # of disk writes
+   * @return the total # of pages written to disk
    */
-  static int getPageWriteCount() { return writeCount; }
+  static long long getPageWriteCount();
+
+  /**
+   * @return the total # of page reads served by pages read ahead
+   */
+  static long long getReadAheadHitCount();
+
+  /**
+   * set the minimum # of pages of disk space reserved with fallocate()
+   * when a file grows. a file is written into reserved space without a
+   * block allocation on every write, so a growing file stays contiguous.
+   * @param pages[IN] the extent size. 0 disables preallocation
+   */
+  static void setExtentSize(int pages) { extentSize = pages; }
+
+  /**
+   * count the extents in which the file system stores a file. the more
+   * extents per page, the more fragmented the file is.
+   * @param filename[IN] the name of the file
+   * @return # extents. -1 if the file system cannot tell
+   */
+  static int countDiskExtents(const std::string& filename);
+
+  /**
+   * set the # of pages read ahead when a file is read sequentially.
+   * @param pages[IN] the read-ahead window. 0 disables read-ahead
+   */
+  static void setReadAheadWindow(int pages) { readAheadWindow = pages; }
+
+  /**
+   * allocate a buffer aligned to IO_ALIGNMENT, so that DIRECT I/O can
+   * use it without a copy.
+   * @param size[IN] size of the buffer in bytes
+   * @return the buffer. release it with freeBuffer()
+   */
+  static char* allocBuffer(size_t size);
+
+  /**
+   * release a buffer allocated by allocBuffer().
+   */
+  static void freeBuffer(char* buffer);
 
  protected:
   /**
-   * move the file cursor to the beginning of a page.
-   * this is an internal function not exposed to public.
-   * @param pid[IN] page to seek to
+   * write the memory buffer to the disk page right away.
+   * the BufferPool calls this function to write back a dirty page.
+   * @param pid[IN] page to write to
+   * @param buffer[IN] the content to write
+   * @return error code. 0 if no error
+   */
+  RC writePage(PageId pid, const void *buffer);
+
+  /**
+   * read a disk page without looking at the buffer pool.
+   * the part of the page that is not on disk yet reads as zeros.
+   * @param pid[IN] the page to read
+   * @param buffer[OUT] pointer to memory buffer of getPageSize() bytes
+   * @return error code. 0 if no error
+   */
+  RC readPage(PageId pid, void *buffer) const;
+
+  /**
+   * compress a page and write it to its extent, or to a new extent at the
+   * end of the file if it does not fit in its extent any more.
+   * @param pid[IN] page to write to
+   * @param buffer[IN] the content to write
+   * @return error code. 0 if no error
+   */
+  RC writeCompressed(PageId pid, const void *buffer);
+
+  /**
+   * read and decompress a page of a compressed file.
+   * @param pid[IN] the page to read
+   * @param buffer[OUT] pointer to memory buffer of getPageSize() bytes
+   * @return error code. 0 if no error
+   */
+  RC readCompressed(PageId pid, void *buffer) const;
+
+  /**
+   * decompress a page read from its extent.
+   * @param packed[IN] the extent of the page
+   * @param length[IN] # bytes of the page in the extent
+   * @param buffer[OUT] pointer to memory buffer of getPageSize() bytes
+   * @return error code. 0 if no error
+   */
+  RC unpackPage(const char* packed, int length, void *buffer) const;
+
+  /**
+   * read ahead the pages [first, first + count) of a compressed file
+   * into the buffer pool with a single disk read.
+   * @param stored[OUT] # pages stored in the buffer pool
+   * @return # pages read ahead. 0 if the pages are scattered over the file
+   */
+  int readAheadCompressed(PageId first, int count, int& stored) const;
+
+  /**
+   * write the page map of a compressed file, if it changed, to the end
+   * of the file and point the header to it.
    * @return error code. 0 if no error
    */
-  RC seek(PageId pid) const;
+  RC writePageMap();
+
+  /**
+   * pread()/pwrite() on the unix file. in DIRECT mode, an unaligned
+   * buffer goes through an aligned bounce buffer (of at most
+   * MAX_PAGE_SIZE bytes), and DIRECT I/O is turned off for the file if
+   * the file system rejects it. every call is counted and timed in the
+   * I/O counters of the file.
+   * @return # bytes read or written. -1 if error
+   */
+  ssize_t readAt(void* buffer, size_t size, off_t offset) const;
+  ssize_t writeAt(const void* buffer, size_t size, off_t offset);
+
+  /**
+   * stop using O_DIRECT for the file.
+   */
+  void disableDirect() const;
+
+  /**
+   * record a page write in the WriteAheadLog and keep the page dirty in
+   * the buffer pool. only the bytes that differ from the cached page are
+   * logged.
+   * @param pid[IN] page to write to
+   * @param buffer[IN] the content to write
+   * @return error code. 0 if no error
+   */
+  RC logWrite(PageId pid, const void *buffer);
+
+  /**
+   * reserve disk space for the pages up to end (exclusive), an extent at
+   * a time. nothing is done if the file system cannot reserve space.
+   * @param end[IN] (the last page that needs disk space + 1)
+   */
+  void preallocate(PageId end);
+
+  /**
+   * extend the memory mapping of the file so that it covers page pid.
+   * the file is grown in chunks and truncated to endPid() at close().
+   * @param pid[IN] the page that has to be mapped
+   * @return error code. 0 if no error
+   */
+  RC growMapping(PageId pid);
+
+  /**
+   * track the sequence of page reads and, once the file is read
+   * sequentially, read the next pages ahead into the buffer pool with
+   * a single disk read.
+   * @param pid[IN] the page that was just read
+   */
+  void readAhead(PageId pid) const;
+
+  /**
+   * @return the offset of page pid in the unix file
+   */
+  off_t offsetOf(PageId pid) const { return base + (off_t)pid * pageSize; }
+
+  friend class BufferPool;
+  friend class PageReadBatch;
 
  private:
   int     fd;     // file descriptor of the associated unix file
-  PageId  epid;   // (last page id + 1) of the file
+  std::atomic<PageId> epid; // (last page id + 1) of the file
+  int     flags;  // option flags given to open()
+  bool    writable; // true if the file was opened in 'w' mode
+  mutable std::atomic<bool> direct; // true while O_DIRECT is in effect
+  int     pageSize; // the page size of the file
+  off_t   base;     // offset of page 0 (the size of the header, if any)
+  int     layout;   // the layout tag in the header
 
-  //
-  // the following set of members implement LRU caching 
-  //
-  static const int CACHE_COUNT = 10;
+  char*   map;      // start of the memory mapping in MMAP mode.
+                    //   the mapping starts at offset 0 of the unix file
+  PageId  mapPages; // # pages covered by the mapping (and the unix file)
+  mutable pthread_rwlock_t mapLatch; // held exclusively while remapping,
+                    //   or while a compressed page is written
+
+  // where a page of a compressed file is stored. the page map is an
+  // array of extents, which is written to disk as it is
+  struct Extent {
+    long long offset;   // offset of the extent in the unix file
+    int       length;   // # bytes of the compressed page. pageSize if the
+                        //   page is stored as is. 0 if never written
+    int       capacity; // size of the extent
+  };
+
+  bool    compressed;     // true if the pages are stored compressed
+  std::vector<Extent> extents; // the page map of a compressed file
+  off_t   dataEnd;        // where the next extent is allocated
+  bool    mapDirty;       // the page map changed since it was written
+
+  // extent allocation
+  std::atomic<PageId> allocEnd; // (last page reserved by allocate() + 1)
+  std::atomic<PageId> reserved; // # pages that have disk space
+  bool    preallocating;  // false if the file system cannot preallocate
+  std::mutex allocLatch;  // serializes preallocate()
+
+  int     fid;    // id of the unix file. used as the key of its pages
+                  // in the BufferPool shared by all PageFiles
+  IOStats* stats; // the I/O counters of the unix file
+
+  std::string path; // the absolute path of the file, which names it in
+                    //   the log in LOGGED mode
+  std::atomic<long long> lastLsn; // end of the last log record of the
+                    //   file. commit() waits for the log up to here
+  std::unordered_map<PageId, long long> pageLsn; // end of the last log
+                    //   record of each page. a dirty page goes to disk
+                    //   after the log up to here
+  std::mutex lsnLatch; // protects pageLsn
 
-  static int cacheClock; // clock tick counter for LRU policy
+  // sequential access detection for read-ahead
+  mutable std::atomic<PageId> lastRead;  // the last page read
+  mutable std::atomic<int>    seqRun;    // # consecutive sequential reads
+  mutable std::atomic<PageId> aheadEnd;  // (last page read ahead + 1)
 
-  // the actual cache data structure
-  static struct cacheStruct {
-    int    fd;              // file id of the cached page
-    PageId pid;             // page id of the cached page
-    int    lastAccessed;    // the last time the cached page was accessed
-                            //   (lastAccessed == 0) means that the buffer is empty
-    char buffer[PAGE_SIZE]; // the buffer used for caching
-  } readCache[CACHE_COUNT];
+  static int readAheadWindow;  // # pages to read ahead
+  static int extentSize;       // min # pages to preallocate
 
-  static int readCount;  // total # of page reads 
-  static int writeCount; // total # of page writes 
+  // a PageFile owns the dirty pages it wrote to the buffer pool,
+  // so it cannot be copied
+  PageFile(const PageFile&);
+  PageFile& operator=(const PageFile&);
 };
   
 #endif // PAGEFILE_H
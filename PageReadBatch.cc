@@ -0,0 +1,406 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "Bruinbase.h"
+#include "PageReadBatch.h"
+#include "BufferPool.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+bool PageReadBatch::ioUringDisabled = false;
+
+// set once io_uring_setup() has failed, so that we do not try again
+static std::atomic<bool> ioUringUnavailable(false);
+
+//
+// a minimal io_uring submission/completion ring driven by the raw
+// system calls, so that no liburing is needed
+//
+struct IoRing {
+  int       fd;
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+
+  void*  sqRing;
+  size_t sqRingSize;
+  void*  cqRing;
+  size_t cqRingSize;
+  size_t sqesSize;
+
+  std::vector<struct iovec> iovecs;  // one per request of the batch
+};
+
+static IoRing* openRing(unsigned entries)
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0) return NULL;
+
+  IoRing* r = new IoRing;
+  r->fd = fd;
+  r->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cqRingSize > r->sqRingSize) r->sqRingSize = r->cqRingSize;
+    r->cqRingSize = r->sqRingSize;
+  }
+  r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  r->sqRing = mmap(NULL, r->sqRingSize, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (r->sqRing == MAP_FAILED) { close(fd); delete r; return NULL; }
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    r->cqRing = r->sqRing;
+  } else {
+    r->cqRing = mmap(NULL, r->cqRingSize, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (r->cqRing == MAP_FAILED) {
+      munmap(r->sqRing, r->sqRingSize);
+      close(fd); delete r; return NULL;
+    }
+  }
+
+  r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqesSize, PROT_READ|PROT_WRITE,
+                                       MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) {
+    if (r->cqRing != r->sqRing) munmap(r->cqRing, r->cqRingSize);
+    munmap(r->sqRing, r->sqRingSize);
+    close(fd); delete r; return NULL;
+  }
+
+  char* sq = (char*)r->sqRing;
+  char* cq = (char*)r->cqRing;
+  r->sqHead  = (unsigned*)(sq + p.sq_off.head);
+  r->sqTail  = (unsigned*)(sq + p.sq_off.tail);
+  r->sqMask  = (unsigned*)(sq + p.sq_off.ring_mask);
+  r->sqArray = (unsigned*)(sq + p.sq_off.array);
+  r->cqHead  = (unsigned*)(cq + p.cq_off.head);
+  r->cqTail  = (unsigned*)(cq + p.cq_off.tail);
+  r->cqMask  = (unsigned*)(cq + p.cq_off.ring_mask);
+  r->cqes    = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+  return r;
+}
+
+static void closeRing(IoRing* r)
+{
+  munmap(r->sqes, r->sqesSize);
+  if (r->cqRing != r->sqRing) munmap(r->cqRing, r->cqRingSize);
+  munmap(r->sqRing, r->sqRingSize);
+  close(r->fd);
+  delete r;
+}
+
+//
+// the I/O threads used when io_uring is not available
+//
+class ReadThreadPool {
+ public:
+  static const int THREAD_COUNT = 8;
+
+  static ReadThreadPool& global()
+  {
+    static ReadThreadPool pool;
+    return pool;
+  }
+
+  void enqueue(PageReadBatch* batch, int index)
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    jobs.push_back(Job(batch, index));
+    wakeup.notify_one();
+  }
+
+ private:
+  typedef std::pair<PageReadBatch*, int> Job;
+
+  ReadThreadPool() : stopping(false)
+  {
+    for (int i = 0; i < THREAD_COUNT; i++) {
+      threads.push_back(std::thread(&ReadThreadPool::work, this));
+    }
+  }
+
+  ~ReadThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> guard(latch);
+      stopping = true;
+      wakeup.notify_all();
+    }
+    for (unsigned i = 0; i < threads.size(); i++) threads[i].join();
+  }
+
+  void work()
+  {
+    for (;;) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> guard(latch);
+        while (jobs.empty() && !stopping) wakeup.wait(guard);
+        if (jobs.empty()) return;
+        job = jobs.front();
+        jobs.pop_front();
+      }
+
+      PageReadBatch* b = job.first;
+      ssize_t n = b->readPage(job.second);
+      b->complete(job.second, (n < 0) ? RC_FILE_READ_FAILED : 0, (int)n);
+    }
+  }
+
+  std::mutex              latch;
+  std::condition_variable wakeup;
+  std::deque<Job>         jobs;
+  std::vector<std::thread> threads;
+  bool                    stopping;
+};
+
+
+PageReadBatch::PageReadBatch()
+{
+  pf = NULL;
+  fd = -1;
+  pageSize = PageFile::PAGE_SIZE;
+  pages = NULL;
+  pagesSize = 0;
+  inflight = 0;
+  returned = 0;
+  ring = NULL;
+}
+
+PageReadBatch::~PageReadBatch()
+{
+  // the I/O in flight still writes into our page buffers
+  drain();
+  if (ring != NULL) closeRing(ring);
+  PageFile::freeBuffer(pages);
+}
+
+void PageReadBatch::reset(const PageFile* pf, int fd, int count)
+{
+  drain();
+
+  this->pf = pf;
+  this->fd = fd;
+  pageSize = pf->getPageSize();
+  requests.clear();
+
+  // the pages are read straight into the buffer, so it is aligned
+  // for DIRECT I/O
+  size_t size = (size_t)count * pageSize;
+  if (size > pagesSize) {
+    PageFile::freeBuffer(pages);
+    pages = PageFile::allocBuffer(size);
+    pagesSize = size;
+  }
+  toIssue.clear();
+  done.clear();
+  returned = 0;
+}
+
+void PageReadBatch::addReady(PageId pid, const void* page)
+{
+  Request r = { pid, 0, -1 };
+  requests.push_back(r);
+  memcpy(pageOf(requests.size() - 1), page, pageSize);
+  done.push_back(requests.size() - 1);
+}
+
+void PageReadBatch::addRead(PageId pid)
+{
+  Request r = { pid, 0, 0 };
+  requests.push_back(r);
+  toIssue.push_back(requests.size() - 1);
+}
+
+void PageReadBatch::submit()
+{
+  if (toIssue.empty()) return;
+
+  // set up the ring the first time this batch reads from disk
+  if (ring == NULL && !ioUringDisabled && !ioUringUnavailable) {
+    ring = openRing(QUEUE_DEPTH);
+    if (ring == NULL) ioUringUnavailable = true;
+  }
+
+  if (ring != NULL) {
+    ring->iovecs.resize(requests.size());
+    issue();
+  } else {
+    // the thread pool queues the reads that exceed its thread count
+    std::lock_guard<std::mutex> guard(latch);
+    inflight += toIssue.size();
+    while (!toIssue.empty()) {
+      ReadThreadPool::global().enqueue(this, toIssue.front());
+      toIssue.pop_front();
+    }
+  }
+}
+
+void PageReadBatch::issue()
+{
+  unsigned count = 0;
+  unsigned tail = *ring->sqTail;
+
+  while (!toIssue.empty() && inflight < QUEUE_DEPTH) {
+    int index = toIssue.front();
+    toIssue.pop_front();
+
+    struct iovec& iov = ring->iovecs[index];
+    iov.iov_base = pageOf(index);
+    iov.iov_len = pageSize;
+
+    unsigned slot = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)&iov;
+    sqe->len = 1;
+    sqe->off = (unsigned long long)offsetOf(index);
+    sqe->user_data = index;
+    ring->sqArray[slot] = slot;
+
+    tail++;
+    count++;
+    inflight++;
+  }
+  if (count == 0) return;
+
+  // publish the new entries to the kernel and submit them
+  __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+  syscall(__NR_io_uring_enter, ring->fd, count, 0, 0, NULL, 0);
+
+  // the kernel has moved the head past the entries it took. the others
+  // (all of them if the call failed) are taken back out of the ring, so
+  // that the next submission does not run them into buffers reused by
+  // then, and they fail instead of hanging
+  unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+  if (head == tail) return;
+  for (unsigned i = head; i != tail; i++) {
+    int index = (int)ring->sqes[i & *ring->sqMask].user_data;
+    requests[index].rc = RC_FILE_READ_FAILED;
+    done.push_back(index);
+    inflight--;
+  }
+  __atomic_store_n(ring->sqTail, head, __ATOMIC_RELEASE);
+}
+
+void PageReadBatch::complete(int index, RC rc, int bytes)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  requests[index].rc = rc;
+  requests[index].bytes = bytes;
+  done.push_back(index);
+  inflight--;
+  arrived.notify_one();
+}
+
+int PageReadBatch::waitCompletion()
+{
+  if (ring == NULL) {
+    std::unique_lock<std::mutex> guard(latch);
+    while (done.empty()) arrived.wait(guard);
+    int index = done.front();
+    done.pop_front();
+    return index;
+  }
+
+  if (!done.empty()) {
+    int index = done.front();
+    done.pop_front();
+    return index;
+  }
+
+  // reap one completion from the ring, waiting for it if necessary
+  unsigned head = *ring->cqHead;
+  while (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+    if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS,
+                NULL, 0) < 0 && errno != EINTR) {
+      return -1;
+    }
+  }
+
+  struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+  int index = (int)cqe->user_data;
+  int res = cqe->res;
+  __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+  inflight--;
+
+  // the read was asynchronous, so it has no syscall latency of its own
+  pf->stats->readCall((res < 0) ? -1 : res, -1);
+
+  // the file system rejected a DIRECT read. read the page again with
+  // pread, which turns DIRECT I/O off for the file
+  if (res == -EINVAL) res = (int)readPage(index);
+
+  requests[index].rc = (res < 0) ? RC_FILE_READ_FAILED : 0;
+  requests[index].bytes = res;
+
+  // keep the queue full
+  issue();
+  return index;
+}
+
+void PageReadBatch::drain()
+{
+  if (ring == NULL) {
+    std::unique_lock<std::mutex> guard(latch);
+    while (inflight > 0) arrived.wait(guard);
+    return;
+  }
+
+  toIssue.clear();
+  while (inflight > 0) {
+    if (waitCompletion() < 0) break;
+  }
+}
+
+RC PageReadBatch::next(PageId& pid, void* buffer)
+{
+  if (returned >= (int)requests.size()) return RC_END_OF_BATCH;
+
+  int index = waitCompletion();
+  if (index < 0) return RC_FILE_READ_FAILED;
+  returned++;
+
+  Request& r = requests[index];
+  pid = r.pid;
+  if (r.rc < 0) return r.rc;
+
+  char* page = pageOf(index);
+  if (r.bytes >= 0) {
+    // the page came from disk. the part beyond the end of the unix
+    // file reads as zeros, as in PageFile::read()
+    if (r.bytes < pageSize) {
+      memset(page + r.bytes, 0, pageSize - r.bytes);
+    }
+    RC rc = BufferPool::global().fill(pf->fid, pid, page, pageSize);
+    if (rc < 0) return rc;
+    pf->stats->pagesRead(1);
+  }
+
+  memcpy(buffer, page, pageSize);
+  return 0;
+}
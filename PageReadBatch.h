@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef PAGEREADBATCH_H
+#define PAGEREADBATCH_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+struct IoRing;
+
+/**
+ * A set of page reads submitted together by PageFile::readAsync().
+ * The reads are issued through io_uring when the kernel supports it
+ * and through a pool of I/O threads otherwise, so that up to
+ * QUEUE_DEPTH pages are in flight at the same time. next() hands out
+ * the pages in the order in which they arrive.
+ * A PageReadBatch is used by one thread at a time.
+ */
+class PageReadBatch {
+ public:
+  static const int QUEUE_DEPTH = 64;   // max # of reads in flight
+
+  PageReadBatch();
+  ~PageReadBatch();
+
+  /**
+   * wait for the next page of the batch to arrive and copy it to buffer.
+   * @param pid[OUT] the id of the page
+   * @param buffer[OUT] memory buffer as large as a page of the file
+   * @return error code. 0 if no error.
+   *         RC_END_OF_BATCH if all pages of the batch have been returned
+   */
+  RC next(PageId& pid, void* buffer);
+
+  /**
+   * @return # of pages of the batch not yet returned by next()
+   */
+  int remaining() const { return (int)(requests.size() - returned); }
+
+  /**
+   * use the I/O thread pool even if io_uring is available.
+   * @param disable[IN] true to disable io_uring
+   */
+  static void disableIoUring(bool disable) { ioUringDisabled = disable; }
+
+ private:
+  friend class PageFile;
+
+  struct Request {
+    PageId pid;
+    RC     rc;       // result of the read
+    int    bytes;    // # bytes read from disk (-1 if served from memory)
+  };
+
+  /**
+   * start a new batch of up to count pages. the pages not yet returned
+   * from the previous batch are discarded.
+   */
+  void reset(const PageFile* pf, int fd, int count);
+
+  /**
+   * add a page whose content is already known (e.g., a buffer pool hit).
+   */
+  void addReady(PageId pid, const void* page);
+
+  /**
+   * add a page that has to be read from disk.
+   */
+  void addRead(PageId pid);
+
+  /**
+   * issue the disk reads added by addRead().
+   */
+  void submit();
+
+  // issue as many pending disk reads as the queue depth allows
+  void issue();
+
+  // wait for all reads in flight to complete
+  void drain();
+
+  // get the index of the next completed request
+  int waitCompletion();
+
+  // called by an I/O thread when a read is done
+  void complete(int index, RC rc, int bytes);
+
+  char* pageOf(int index) { return pages + (size_t)index * pageSize; }
+
+  // the offset of the page of a request in the unix file
+  off_t offsetOf(int index) const { return pf->offsetOf(requests[index].pid); }
+
+  // read the page of a request with a blocking pread
+  ssize_t readPage(int index) { return pf->readAt(pageOf(index), pageSize, offsetOf(index)); }
+
+  const PageFile* pf;   // the file the pages are read from
+  int fd;               // its unix file descriptor
+  int pageSize;         // its page size
+
+  std::vector<Request> requests;
+  char*  pages;                   // the page buffer of every request,
+                                  //   aligned for DIRECT I/O
+  size_t pagesSize;               // size of the pages buffer
+  std::deque<int>      toIssue;   // requests waiting to be issued
+  int inflight;                   // # reads issued but not completed
+  int returned;                   // # pages returned by next()
+
+  IoRing* ring;                   // NULL if io_uring is not used
+
+  // completion queue filled by the I/O threads
+  std::mutex              latch;
+  std::condition_variable arrived;
+  std::deque<int>         done;
+
+  static bool ioUringDisabled;
+
+  friend class ReadThreadPool;
+
+  PageReadBatch(const PageReadBatch&);
+  PageReadBatch& operator=(const PageReadBatch&);
+};
+
+#endif // PAGEREADBATCH_H
@@ -9,9 +9,15 @@
 
 #include "Bruinbase.h"
 #include "RecordFile.h"
+#include "BufferPool.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
 #include <cstring>
+#include <unistd.h>
 
 using std::string;
+using std::vector;
 
 //
 // helper functions for page manipultation
@@ -21,7 +27,7 @@ using std::string;
 static char* slotPtr(char* page, int n);
 
 // read the record in the n'th slot in the page
-static void readSlot(const char* page, int n, int& key, std::string& value);
+static void readSlot(const char* page, int n, int& key, ValueView& value);
 
 // write the record to the n'th slot in the page
 static void writeSlot(char* page, int n, int key, const std::string& value);
@@ -32,36 +38,82 @@ static int getRecordCount(const char* page);
 // update # records stored in the page
 static void setRecordCount(char* page, int count);
 
+//
+// helper functions for SLOTTED pages. a SLOTTED page starts with the
+// record count, the offset where the records start, and the slot
+// directory. slot n gives the offset and the length of record n, which
+// is the key followed by the value without the trailing NUL. the
+// records are packed at the end of the page, the first at the very end
+//
+struct Slot {
+  unsigned short offset;  // where the record starts in the page
+  unsigned short length;  // # bytes of the record
+};
+
+// the size of the fixed part of a SLOTTED page
+static const int SLOTTED_HEADER = 2 * sizeof(int);
+
+// read the record in the n'th slot of a SLOTTED page
+static void readSlotted(const char* page, int n, int& key, ValueView& value);
+
+// append a record to a SLOTTED page with n records.
+// return false if the record does not fit in the page
+static bool appendSlotted(char* page, int pageSize, int n, int key, const std::string& value);
+
+// rewrite the record in the n'th slot of a SLOTTED page, in its old
+// place if the new record is not longer, or else in the free space of
+// the page. return false if the record does not fit in the page
+static bool updateSlotted(char* page, int n, int key, const std::string& value);
 
 //
-// helper functions for RecordId manipulation
+// a page of the key column of a COLUMNAR file holds the record count,
+// a bitmap of the deleted records and the keys. the value column is an
+// array of MAX_VALUE_LENGTH byte slots, each a NUL-terminated value,
+// without page headers
 //
 
-// postfix record id iterator
-RecordId operator++ (RecordId& rid, int)
-{
-  RecordId prid(rid);
+// the suffix added to the file name to name the value column
+static const char* VALUE_COLUMN_SUFFIX = ".val";
 
-  // if the end of a page is reached, move to the next page
-  if (++rid.sid >= RecordFile::RECORDS_PER_PAGE) {
-    rid.pid++;
-    rid.sid = 0;
-  }
+// compute the pointer to the n'th key in a page of the key column
+// with recordsPerPage keys
+static char* keyPtr(char* page, int recordsPerPage, int n);
 
-  return prid;
-}
+// write a value to a slot of the value column
+static void writeValueSlot(char* ptr, const std::string& value);
 
-// prefix record id iterator
-RecordId& operator++ (RecordId& rid)
-{
-  // if the end of a page is reached, move to the next page
-  if (++rid.sid >= RecordFile::RECORDS_PER_PAGE) {
-    rid.pid++;
-    rid.sid = 0;
-  } 
+// read the key of the n'th record in a page of the given format
+static void readKeyAt(const char* page, RecordFile::Format format, int recordsPerPage,
+                      int n, int& key);
 
-  return rid;
-}
+//
+// a deleted record leaves a tombstone in its slot until the file is
+// compacted: the deletion bit of a COLUMNAR key page, a zero length in
+// a SLOTTED slot, and a 1 in the last byte of a fixed slot, which is
+// the NUL of the longest value in a live slot
+//
+
+//
+// a page of the zone map holds the zone count and the zones, each the
+// smallest and the largest key of a page of the file, in page order
+//
+
+// the suffix added to the file name to name the zone map
+static const char* ZONE_MAP_SUFFIX = ".zm";
+
+// # zones in a page of the zone map
+static int zonesPerPage(int pageSize);
+
+// return true if the n'th record of the page is deleted
+static bool isDeleted(const char* page, RecordFile::Format format, int n);
+
+// mark the n'th record of the page deleted
+static void setDeleted(char* page, RecordFile::Format format, int n);
+
+
+//
+// helper functions for RecordId manipulation
+//
 
 // RecordId comparators
 bool operator < (const RecordId& r1, const RecordId& r2)
@@ -103,24 +155,84 @@ bool operator != (const RecordId& r1, const RecordId& r2)
 }
 
 
+int ValueView::compare(const char* s) const
+{
+  // the bytes compare as unsigned chars, as in strcmp()
+  int n = strlen(s);
+  int diff = memcmp(data, s, std::min(length, n));
+  if (diff != 0) return diff;
+  return length - n;
+}
+
 RecordFile::RecordFile()
 {
   erid.pid = 0;
   erid.sid = 0;
+  recordsPerPage = 0;
+  valuesPerPage = 0;
+  format = FIXED_SLOTS;
+  countCache = -1;
+  appendWrites = 0;
+  zoned = false;
+  zonesRead = false;
 }
 
-RecordFile::RecordFile(const string& filename, char mode)
+RecordFile::RecordFile(const string& filename, char mode, int flags, int pageSize, Format format)
 {
-  open(filename, mode);
+  erid.pid = 0;
+  erid.sid = 0;
+  recordsPerPage = 0;
+  valuesPerPage = 0;
+  this->format = FIXED_SLOTS;
+  countCache = -1;
+  appendWrites = 0;
+  zoned = false;
+  zonesRead = false;
+  open(filename, mode, flags, pageSize, format);
 }
 
-RC RecordFile::open(const string& filename, char mode)
+RC RecordFile::open(const string& filename, char mode, int flags, int pageSize, Format format)
 {
   RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  char page[PageFile::MAX_PAGE_SIZE];
+
+  // open the page file. the record format is the layout tag of the file
+  if ((rc = pf.open(filename, mode, flags, pageSize, format)) < 0) return rc;
+  if (pf.getLayout() != FIXED_SLOTS && pf.getLayout() != SLOTTED &&
+      pf.getLayout() != COLUMNAR) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+  this->format = (Format)pf.getLayout();
+  countCache = -1;
+  appendWrites = 0;
 
-  // open the page file
-  if ((rc = pf.open(filename, mode)) < 0) return rc;
+  if (this->format == COLUMNAR) {
+    // open the value column next to the keys, with the same page size
+    rc = vf.open(filename + VALUE_COLUMN_SUFFIX, mode, flags, pf.getPageSize(), COLUMNAR);
+    if (rc == 0 && vf.getLayout() != COLUMNAR) {
+      vf.close();
+      rc = RC_INVALID_FILE_FORMAT;
+    }
+    if (rc < 0) {
+      pf.close();
+      return rc;
+    }
+
+    // a key page holds the record count, and a key and a deletion bit
+    // for every record
+    recordsPerPage = (pf.getPageSize() - sizeof(int)) * 8 / (sizeof(int) * 8 + 1);
+    valuesPerPage = pf.getPageSize() / MAX_VALUE_LENGTH;
+  } else if (this->format == SLOTTED) {
+    // a page holds at most as many records as it has room for slots
+    // of records with an empty value
+    recordsPerPage = (pf.getPageSize() - SLOTTED_HEADER) / (sizeof(Slot) + sizeof(int));
+  } else {
+    // the number of record slots depends on the page size of the file.
+    // note that we subtract sizeof(int) from the page size because the
+    // first four bytes in the page is used to store # records in the page.
+    recordsPerPage = (pf.getPageSize() - sizeof(int)) / (sizeof(int) + MAX_VALUE_LENGTH);
+  }
   
   //
   // in the rest of this function, we set the end record id
@@ -133,7 +245,7 @@ RC RecordFile::open(const string& filename, char mode)
   // set the end record id to (0, 0).
   if (erid.pid == 0) {
     erid.sid = 0;
-    return 0;
+    return openZoneMap(filename, mode, flags);
   }
 
   // obtain # records in the last page to set sid of the end record id.
@@ -142,52 +254,265 @@ RC RecordFile::open(const string& filename, char mode)
   if ((rc = pf.read(--erid.pid, page)) < 0) {
     // an error occurred during page read
     erid.pid = erid.sid = 0;
+    if (this->format == COLUMNAR) vf.close();
     pf.close();
     return rc;
   }
 
-  // get # records in the last page
+  // get # records in the last page. the next record goes to the last
+  // page of a SLOTTED file as long as it fits there
   erid.sid = getRecordCount(page);
-  if (erid.sid >= RECORDS_PER_PAGE) {
+  if (this->format != SLOTTED && erid.sid >= recordsPerPage) {
     // the last page is full. advance the end record id to the next page.
     erid.pid++;
     erid.sid = 0;
   }
   
+  return openZoneMap(filename, mode, flags);
+}
+
+RC RecordFile::openZoneMap(const string& filename, char mode, int flags)
+{
+  RC  rc = 0;
+  int perPage = zonesPerPage(pf.getPageSize());
+
+  zones.clear();
+  zoned = false;
+  zonesRead = false;
+  if ((rc = zf.open(filename + ZONE_MAP_SUFFIX, mode, flags, pf.getPageSize(), format)) < 0) {
+    // a file written before zone maps has none. all its pages are read
+    if (mode != 'w') return 0;
+    if (format == COLUMNAR) vf.close();
+    pf.close();
+    return rc;
+  }
+
+  // a query that uses no zones does not read them
+  zoned = true;
+  if (mode != 'w') return 0;
+  readZones();
+  if (zones.size() == (unsigned)pf.endPid()) return 0;
+
+  // the zones of the pages the zone map does not cover are computed
+  // from the keys of the pages, deleted or not, and written before
+  // any record is added
+  PageId first = zones.size();
+  for (PageId pid = first; pid < pf.endPid(); pid++) {
+    PageGuard guard;
+    if ((rc = pf.pin(pid, guard)) < 0) break;
+    int count = std::max(0, std::min(getRecordCount(guard.data()), recordsPerPage));
+    Zone zone = { INT_MAX, INT_MIN };
+    for (int n = 0; n < count; n++) {
+      int key;
+      readKeyAt(guard.data(), format, recordsPerPage, n, key);
+      zone.min = std::min(zone.min, key);
+      zone.max = std::max(zone.max, key);
+    }
+    zones.push_back(zone);
+  }
+  for (PageId pid = first; rc == 0 && pid < (PageId)zones.size(); pid += perPage - pid % perPage) {
+    rc = writeZone(pid);
+  }
+  if (rc < 0) {
+    zf.close();
+    zoned = false;
+    if (format == COLUMNAR) vf.close();
+    pf.close();
+    return rc;
+  }
+  return 0;
+}
+
+RC RecordFile::renameFile(const string& from, const string& to)
+{
+  // the value column goes first. a file without one has nothing to rename
+  string vfrom = from + VALUE_COLUMN_SUFFIX;
+  if (::access(vfrom.c_str(), F_OK) == 0 &&
+      ::rename(vfrom.c_str(), (to + VALUE_COLUMN_SUFFIX).c_str()) < 0) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  string zfrom = from + ZONE_MAP_SUFFIX;
+  if (::access(zfrom.c_str(), F_OK) == 0 &&
+      ::rename(zfrom.c_str(), (to + ZONE_MAP_SUFFIX).c_str()) < 0) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  if (::rename(from.c_str(), to.c_str()) < 0) return RC_FILE_WRITE_FAILED;
   return 0;
 }
 
+void RecordFile::removeFile(const string& filename)
+{
+  ::unlink((filename + VALUE_COLUMN_SUFFIX).c_str());
+  ::unlink((filename + ZONE_MAP_SUFFIX).c_str());
+  ::unlink(filename.c_str());
+}
+
 RC RecordFile::close()
 {
+  RC rc = 0;
+
   erid.pid = 0;
   erid.sid = 0;
+  recordsPerPage = 0;
+  valuesPerPage = 0;
+  countCache = -1;
+  zones.clear();
+  zonesRead = false;
+
+  if (format == COLUMNAR) rc = vf.close();
+  format = FIXED_SLOTS;
+  RC rc2 = zoned ? zf.close() : 0;
+  if (rc == 0) rc = rc2;
+  zoned = false;
+  rc2 = pf.close();
+  return (rc < 0) ? rc : rc2;
+}
+
+RC RecordFile::commit()
+{
+  RC rc;
 
-  return pf.close();
+  // the keys are committed last. with LOGGED, both files share the log,
+  // so the commit of the keys makes the values durable as well
+  if (format == COLUMNAR && (rc = vf.commit()) < 0) return rc;
+  if (zoned && (rc = zf.commit()) < 0) return rc;
+  return pf.commit();
 }
 
 RC RecordFile::read(const RecordId& rid, int& key, string& value) const
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  RC        rc;
+  PageGuard page;
+  ValueView view;
+
+  // copy the value out of the page before it is unpinned
+  if ((rc = read(rid, key, view, page)) < 0) return rc;
+  value.assign(view.data, view.length);
+
+  return 0;
+}
+
+RC RecordFile::read(const RecordId& rid, int& key, ValueView& value, PageGuard& page) const
+{
+  RC rc;
   
   // check whether the rid is in the valid range
   if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
-  if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+  if (rid.sid < 0 || rid.sid >= recordsPerPage) return RC_INVALID_RID;
   if (rid >= erid) return RC_INVALID_RID;
   
-  // read the page containing the record
-  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
+  // pin the page containing the record in the buffer pool
+  if ((rc = pf.pin(rid.pid, page)) < 0) return rc;
+
+  if (format == SLOTTED && rid.sid >= getRecordCount(page.data())) return RC_INVALID_RID;
+  if (isDeleted(page.data(), format, rid.sid)) return RC_NO_SUCH_RECORD;
 
   // read the record from the slot in the page
-  readSlot(page, rid.sid, key, value);
+  if (format == SLOTTED) {
+    readSlotted(page.data(), rid.sid, key, value);
+  } else if (format == COLUMNAR) {
+    // the guard moves on to the page of the value
+    readKeyAt(page.data(), format, recordsPerPage, rid.sid, key);
+    return readValue(rid, value, page);
+  } else {
+    readSlot(page.data(), rid.sid, key, value);
+  }
+
+  return 0;
+}
+
+RC RecordFile::readKey(const RecordId& rid, int& key) const
+{
+  RC        rc;
+  PageGuard page;
+
+  // check whether the rid is in the valid range
+  if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
+  if (rid.sid < 0 || rid.sid >= recordsPerPage) return RC_INVALID_RID;
+  if (rid >= erid) return RC_INVALID_RID;
+
+  if ((rc = pf.pin(rid.pid, page)) < 0) return rc;
+  if (format == SLOTTED && rid.sid >= getRecordCount(page.data())) return RC_INVALID_RID;
+  if (isDeleted(page.data(), format, rid.sid)) return RC_NO_SUCH_RECORD;
+
+  readKeyAt(page.data(), format, recordsPerPage, rid.sid, key);
+  return 0;
+}
+
+RC RecordFile::readValue(const RecordId& rid, ValueView& value, PageGuard& page) const
+{
+  RC rc;
+
+  // the n'th record of the file has the n'th value slot
+  long long n = (long long)rid.pid * recordsPerPage + rid.sid;
+  if ((rc = vf.pin(n / valuesPerPage, page)) < 0) return rc;
+
+  value.data = page.data() + (n % valuesPerPage) * MAX_VALUE_LENGTH;
+  value.length = strnlen(value.data, MAX_VALUE_LENGTH);
+  return 0;
+}
+
+RC RecordFile::prefetch(const vector<RecordId>& rids)
+{
+  RC     rc;
+  PageId pid;
+  char   page[PageFile::MAX_PAGE_SIZE];
+
+  // collect the distinct pages of the records, and of their values
+  // in a COLUMNAR file
+  vector<PageId> pids;
+  vector<PageId> vpids;
+  for (unsigned i = 0; i < rids.size(); i++) {
+    if (rids[i].pid < 0 || rids[i] >= erid) return RC_INVALID_RID;
+    pids.push_back(rids[i].pid);
+    if (format == COLUMNAR) {
+      vpids.push_back(((long long)rids[i].pid * recordsPerPage + rids[i].sid) / valuesPerPage);
+    }
+  }
+  std::sort(pids.begin(), pids.end());
+  pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+  std::sort(vpids.begin(), vpids.end());
+  vpids.erase(std::unique(vpids.begin(), vpids.end()), vpids.end());
+
+  // issue the reads and wait until all pages are in the buffer pool
+  if ((rc = pf.readAsync(pids, batch)) < 0) return rc;
+  while ((rc = batch.next(pid, page)) != RC_END_OF_BATCH) {
+    if (rc < 0) return rc;
+  }
+  if (vpids.empty()) return 0;
+  if ((rc = vf.readAsync(vpids, batch)) < 0) return rc;
+  while ((rc = batch.next(pid, page)) != RC_END_OF_BATCH) {
+    if (rc < 0) return rc;
+  }
 
   return 0;
 }
 
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
+{
+  // a single record reads the last page and writes it back
+  return appendRecords(&key, &value, 1, &rid);
+}
+
+RC RecordFile::appendBatch(const vector<int>& keys, const vector<string>& values,
+                           vector<RecordId>& rids)
+{
+  if (keys.size() != values.size()) return RC_INVALID_ATTRIBUTE;
+  rids.resize(keys.size());
+  if (keys.empty()) return 0;
+  return appendRecords(&keys[0], &values[0], keys.size(), &rids[0]);
+}
+
+RC RecordFile::appendRecords(const int* keys, const string* values, int n, RecordId* rids)
 {
   RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  char page[PageFile::MAX_PAGE_SIZE];
+  char vpage[PageFile::MAX_PAGE_SIZE];
+  int  pageSize = pf.getPageSize();
+  bool dirty = false;    // page has records that are not written yet
+  PageId vpid = -1;      // the page of the value column in vpage if COLUMNAR
+  bool vdirty = false;   // vpage has values that are not written yet
+  RC   result = 0;
 
   // unless we are writing to the the first slot of an empty page,
   // we have to read the page first
@@ -196,26 +521,219 @@ RC RecordFile::append(int key, const std::string& value, RecordId& rid)
   } else {
     // if this is the first slot of an empty page
     // we can simply initialize the page with zeros
-    memset(page, 0, PageFile::PAGE_SIZE);
+    memset(page, 0, pageSize);
   }
-    
-  // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
 
-  // the first four bytes in the page stores # records in the page.
-  // update this number.
-  setRecordCount(page, erid.sid + 1);
+  for (int i = 0; i < n; i++) {
+    if (format == SLOTTED) {
+      // start a new page when the record does not fit in the last one
+      if (!appendSlotted(page, pageSize, erid.sid, keys[i], values[i])) {
+        if (erid.sid == 0) {
+          // the records before it are still written
+          result = RC_INVALID_ATTRIBUTE;
+          break;
+        }
+        if (dirty && (rc = writeAppended(pf, erid.pid, page)) < 0) return rc;
+        erid.pid++;
+        erid.sid = 0;
+        memset(page, 0, pageSize);
+        appendSlotted(page, pageSize, 0, keys[i], values[i]);
+      }
+      setRecordCount(page, erid.sid + 1);
+      dirty = true;
+      rids[i] = erid;
+      addToZone(erid, keys[i]);
+      erid.sid++;
+      continue;
+    }
 
-  // write the page to the disk
-  if ((rc = pf.write(erid.pid, page)) < 0) return rc;
-    
-  // we need to output the rid of the record slot
-  rid = erid;
+    if (format == COLUMNAR) {
+      // the n'th record of the file has the n'th value slot
+      long long pos = (long long)erid.pid * recordsPerPage + erid.sid;
+      if (pos / valuesPerPage != vpid) {
+        if (vdirty && (rc = writeAppended(vf, vpid, vpage)) < 0) return rc;
+        vpid = pos / valuesPerPage;
+        vdirty = false;
+        if (pos % valuesPerPage > 0) {
+          if ((rc = vf.read(vpid, vpage)) < 0) return rc;
+        } else {
+          memset(vpage, 0, pageSize);
+        }
+      }
+      writeValueSlot(vpage + (pos % valuesPerPage) * MAX_VALUE_LENGTH, values[i]);
+      vdirty = true;
+      memcpy(keyPtr(page, recordsPerPage, erid.sid), &keys[i], sizeof(int));
+    } else {
+      // write the record to the first empty slot 
+      writeSlot(page, erid.sid, keys[i], values[i]);
+    }
 
-  // advance the end record id by one to the next empty slot
-  ++erid;
+    // the first four bytes in the page stores # records in the page.
+    // update this number.
+    setRecordCount(page, erid.sid + 1);
+    dirty = true;
 
-  return 0;
+    // we need to output the rid of the record slot
+    rids[i] = erid;
+    addToZone(erid, keys[i]);
+
+    // write a full page once. the values go first, so that a logged
+    // key never refers to a value that is not in the log
+    if (erid.sid + 1 >= recordsPerPage) {
+      if (vdirty && (rc = writeAppended(vf, vpid, vpage)) < 0) return rc;
+      vdirty = false;
+      if ((rc = writeAppended(pf, erid.pid, page)) < 0) return rc;
+      dirty = false;
+      memset(page, 0, pageSize);
+    }
+
+    // advance the end record id by one to the next empty slot
+    nextRid(erid);
+  }
+
+  // write the pages the batch left partly filled
+  if (vdirty && (rc = writeAppended(vf, vpid, vpage)) < 0) return rc;
+  if (dirty && (rc = writeAppended(pf, erid.pid, page)) < 0) return rc;
+
+  return result;
+}
+
+RC RecordFile::writeAppended(PageFile& file, PageId pid, const char* page)
+{
+  RC rc;
+
+  // the zone of a page is written before the page, so that the zone
+  // map never misses a key that the page has
+  if (&file == &pf && (rc = writeZone(pid)) < 0) return rc;
+
+  appendWrites++;
+  return file.write(pid, page);
+}
+
+void RecordFile::readZones() const
+{
+  char page[PageFile::MAX_PAGE_SIZE];
+  int  perPage = zonesPerPage(pf.getPageSize());
+
+  std::lock_guard<std::mutex> lock(zoneLatch);
+  if (zonesRead) return;
+
+  // the last page of the zone map may be partly filled. the zones
+  // after a page that cannot be read are not used
+  for (PageId zpid = 0; zoned && zpid < zf.endPid(); zpid++) {
+    if (zf.read(zpid, page) < 0) break;
+    int count = std::max(0, std::min(getRecordCount(page), perPage));
+    Zone zone;
+    for (int i = 0; i < count; i++) {
+      memcpy(&zone, page + sizeof(int) + i * sizeof(Zone), sizeof(Zone));
+      zones.push_back(zone);
+    }
+    if (count < perPage) break;
+  }
+  if (zones.size() > (unsigned)pf.endPid()) zones.resize(pf.endPid());
+  zonesRead = true;
+}
+
+void RecordFile::addToZone(const RecordId& rid, int key)
+{
+  Zone zone = { key, key };
+
+  // a page the zone map does not cover stays uncovered
+  if (rid.sid == 0 && rid.pid == (PageId)zones.size()) {
+    zones.push_back(zone);
+  } else if (rid.pid < (PageId)zones.size()) {
+    if (rid.sid == 0) zones[rid.pid] = zone;
+    zones[rid.pid].min = std::min(zones[rid.pid].min, key);
+    zones[rid.pid].max = std::max(zones[rid.pid].max, key);
+  }
+}
+
+RC RecordFile::writeZone(PageId pid)
+{
+  char page[PageFile::MAX_PAGE_SIZE];
+  int  perPage = zonesPerPage(pf.getPageSize());
+
+  if (pid >= (PageId)zones.size()) return 0;
+
+  // write the whole page of the zone map holding the zone
+  PageId first = pid - pid % perPage;
+  int count = std::min(perPage, (int)zones.size() - first);
+  memset(page, 0, pf.getPageSize());
+  setRecordCount(page, count);
+  memcpy(page + sizeof(int), &zones[first], count * sizeof(Zone));
+  return zf.write(first / perPage, page);
+}
+
+bool RecordFile::mayHaveKeys(PageId pid, int low, int high) const
+{
+  if (!zonesRead) readZones();
+  if (pid < 0 || pid >= (PageId)zones.size()) return true;
+  return zones[pid].min <= high && zones[pid].max >= low;
+}
+
+RC RecordFile::update(RecordId& rid, int key, const string& value)
+{
+  RC   rc;
+  char page[PageFile::MAX_PAGE_SIZE];
+  char vpage[PageFile::MAX_PAGE_SIZE];
+
+  // check whether the rid is in the valid range
+  if (rid.pid < 0 || rid.sid < 0 || rid.sid >= recordsPerPage) return RC_INVALID_RID;
+  if (rid >= erid) return RC_INVALID_RID;
+
+  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
+  if (format == SLOTTED && rid.sid >= getRecordCount(page)) return RC_INVALID_RID;
+  if (isDeleted(page, format, rid.sid)) return RC_NO_SUCH_RECORD;
+
+  switch (format) {
+  case SLOTTED:
+    if (updateSlotted(page, rid.sid, key, value)) break;
+
+    // the record no longer fits in its page. it moves to the end of the file
+    setDeleted(page, format, rid.sid);
+    if ((rc = pf.write(rid.pid, page)) < 0) return rc;
+    return append(key, value, rid);
+  case COLUMNAR: {
+    // the value goes first, as in append()
+    long long n = (long long)rid.pid * recordsPerPage + rid.sid;
+    if ((rc = vf.read(n / valuesPerPage, vpage)) < 0) return rc;
+    writeValueSlot(vpage + (n % valuesPerPage) * MAX_VALUE_LENGTH, value);
+    if ((rc = vf.write(n / valuesPerPage, vpage)) < 0) return rc;
+    memcpy(keyPtr(page, recordsPerPage, rid.sid), &key, sizeof(int));
+    break;
+  }
+  default:
+    writeSlot(page, rid.sid, key, value);
+    break;
+  }
+
+  // the zone of the page keeps the old key, which may be in other records
+  if (rid.pid < (PageId)zones.size() &&
+      (key < zones[rid.pid].min || key > zones[rid.pid].max)) {
+    zones[rid.pid].min = std::min(zones[rid.pid].min, key);
+    zones[rid.pid].max = std::max(zones[rid.pid].max, key);
+    if ((rc = writeZone(rid.pid)) < 0) return rc;
+  }
+
+  return pf.write(rid.pid, page);
+}
+
+RC RecordFile::remove(const RecordId& rid)
+{
+  RC   rc;
+  char page[PageFile::MAX_PAGE_SIZE];
+
+  // check whether the rid is in the valid range
+  if (rid.pid < 0 || rid.sid < 0 || rid.sid >= recordsPerPage) return RC_INVALID_RID;
+  if (rid >= erid) return RC_INVALID_RID;
+
+  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
+  if (format == SLOTTED && rid.sid >= getRecordCount(page)) return RC_INVALID_RID;
+  if (isDeleted(page, format, rid.sid)) return RC_NO_SUCH_RECORD;
+
+  // the slot stays, and the records after it keep their ids
+  setDeleted(page, format, rid.sid);
+  return pf.write(rid.pid, page);
 }
 
 const RecordId& RecordFile::endRid() const
@@ -223,6 +741,124 @@ const RecordId& RecordFile::endRid() const
   return erid;
 }
 
+void RecordFile::nextRid(RecordId& rid) const
+{
+  // a SLOTTED page holds as many records as fit. the last page
+  // ends at endRid()
+  int count = recordsPerPage;
+  if (format == SLOTTED) {
+    if (rid.pid >= erid.pid) {
+      rid.sid++;
+      return;
+    }
+    count = recordCount(rid.pid);
+  }
+
+  // if the end of a page is reached, move to the next page
+  if (++rid.sid >= count) {
+    rid.pid++;
+    rid.sid = 0;
+  }
+}
+
+int RecordFile::recordCount(PageId pid) const
+{
+  // a scan asks for the count of the same page once per record
+  long long cached = countCache;
+  if (cached >= 0 && (PageId)(cached >> 32) == pid) return (int)(cached & 0xFFFFFFFF);
+
+  PageGuard page;
+  if (pf.pin(pid, page) < 0) return 0;
+  int count = getRecordCount(page.data());
+  countCache = ((long long)pid << 32) | (unsigned)count;
+  return count;
+}
+
+RecordScan::RecordScan(const RecordFile& rf) : rf(rf)
+{
+  cursor.pid = 0;
+  cursor.sid = 0;
+  count = 0;
+  low = INT_MIN;
+  high = INT_MAX;
+}
+
+RC RecordScan::fetch()
+{
+  RC rc;
+
+  for (;;) {
+    if (cursor >= rf.erid) return RC_END_OF_SCAN;
+
+    // skip the pages the zone map rules out without reading them
+    if (page.pageId() != cursor.pid && !rf.mayHaveKeys(cursor.pid, low, high)) {
+      cursor.pid++;
+      cursor.sid = 0;
+      continue;
+    }
+
+    // pin the page once for all of its records
+    if (page.pageId() != cursor.pid) {
+      if ((rc = rf.pf.pin(cursor.pid, page)) < 0) return rc;
+      count = std::max(0, std::min(getRecordCount(page.data()), rf.recordsPerPage));
+    }
+    // skip the tombstones of deleted records
+    while (cursor.sid < count &&
+           isDeleted(page.data(), rf.format, cursor.sid)) {
+      cursor.sid++;
+    }
+    if (cursor.sid < count) return 0;
+
+    // the records of the page are exhausted
+    cursor.pid++;
+    cursor.sid = 0;
+  }
+}
+
+RC RecordScan::next(RecordId& rid, int& key, ValueView& value)
+{
+  RC rc;
+
+  if ((rc = fetch()) < 0) return rc;
+
+  switch (rf.format) {
+  case RecordFile::SLOTTED:
+    readSlotted(page.data(), cursor.sid, key, value);
+    break;
+  case RecordFile::COLUMNAR: {
+    readKeyAt(page.data(), rf.format, rf.recordsPerPage, cursor.sid, key);
+
+    // the value page changes once every valuesPerPage records
+    long long n = (long long)cursor.pid * rf.recordsPerPage + cursor.sid;
+    if (valuePage.pageId() != n / rf.valuesPerPage) {
+      if ((rc = rf.vf.pin(n / rf.valuesPerPage, valuePage)) < 0) return rc;
+    }
+    value.data = valuePage.data() + (n % rf.valuesPerPage) * RecordFile::MAX_VALUE_LENGTH;
+    value.length = strnlen(value.data, RecordFile::MAX_VALUE_LENGTH);
+    break;
+  }
+  default:
+    readSlot(page.data(), cursor.sid, key, value);
+    break;
+  }
+
+  rid = cursor;
+  cursor.sid++;
+  return 0;
+}
+
+RC RecordScan::nextKey(RecordId& rid, int& key)
+{
+  RC rc;
+
+  if ((rc = fetch()) < 0) return rc;
+  readKeyAt(page.data(), rf.format, rf.recordsPerPage, cursor.sid, key);
+
+  rid = cursor;
+  cursor.sid++;
+  return 0;
+}
+
 static int getRecordCount(const char* page)
 {
   int count;
@@ -247,7 +883,80 @@ static char* slotPtr(char* page, int n)
   return (page+sizeof(int)) + (sizeof(int)+RecordFile::MAX_VALUE_LENGTH)*n;
 }
 
-static void readSlot(const char* page, int n, int& key, std::string& value)
+static int zonesPerPage(int pageSize)
+{
+  // the zone count comes first, then the zones
+  return (pageSize - sizeof(int)) / (2 * sizeof(int));
+}
+
+static char* keyPtr(char* page, int recordsPerPage, int n)
+{
+  // the record count and the deletion bitmap come first, then the keys
+  return page + sizeof(int) + (recordsPerPage + 7) / 8 + sizeof(int) * n;
+}
+
+static bool isDeleted(const char* page, RecordFile::Format format, int n)
+{
+  Slot slot;
+
+  switch (format) {
+  case RecordFile::SLOTTED:
+    memcpy(&slot, page + SLOTTED_HEADER + n * sizeof(Slot), sizeof(Slot));
+    return slot.length == 0;
+  case RecordFile::COLUMNAR:
+    return (page[sizeof(int) + n / 8] >> (n % 8)) & 1;
+  default:
+    return slotPtr(const_cast<char*>(page), n)[sizeof(int) + RecordFile::MAX_VALUE_LENGTH - 1] != 0;
+  }
+}
+
+static void setDeleted(char* page, RecordFile::Format format, int n)
+{
+  Slot slot;
+
+  switch (format) {
+  case RecordFile::SLOTTED:
+    memcpy(&slot, page + SLOTTED_HEADER + n * sizeof(Slot), sizeof(Slot));
+    slot.length = 0;
+    memcpy(page + SLOTTED_HEADER + n * sizeof(Slot), &slot, sizeof(Slot));
+    break;
+  case RecordFile::COLUMNAR:
+    page[sizeof(int) + n / 8] |= 1 << (n % 8);
+    break;
+  default:
+    slotPtr(page, n)[sizeof(int) + RecordFile::MAX_VALUE_LENGTH - 1] = 1;
+    break;
+  }
+}
+
+static void writeValueSlot(char* ptr, const std::string& value)
+{
+  // a value is truncated as in a fixed slot
+  memset(ptr, 0, RecordFile::MAX_VALUE_LENGTH);
+  memcpy(ptr, value.c_str(), std::min((int)strlen(value.c_str()), RecordFile::MAX_VALUE_LENGTH - 1));
+}
+
+static void readKeyAt(const char* page, RecordFile::Format format, int recordsPerPage,
+                      int n, int& key)
+{
+  Slot slot;
+
+  // the key is the first field of a record
+  switch (format) {
+  case RecordFile::SLOTTED:
+    memcpy(&slot, page + SLOTTED_HEADER + n * sizeof(Slot), sizeof(Slot));
+    memcpy(&key, page + slot.offset, sizeof(int));
+    break;
+  case RecordFile::COLUMNAR:
+    memcpy(&key, keyPtr(const_cast<char*>(page), recordsPerPage, n), sizeof(int));
+    break;
+  default:
+    memcpy(&key, slotPtr(const_cast<char*>(page), n), sizeof(int));
+    break;
+  }
+}
+
+static void readSlot(const char* page, int n, int& key, ValueView& value)
 {
   // compute the location of the record
   char *ptr = slotPtr(const_cast<char*>(page), n);
@@ -255,8 +964,9 @@ static void readSlot(const char* page, int n, int& key, std::string& value)
   // read the key 
   memcpy(&key, ptr, sizeof(int));
 
-  // read the value
-  value.assign(ptr + sizeof(int));     //?????????????????????????????
+  // the value ends at its NUL, which writeSlot() always leaves in the slot
+  value.data = ptr + sizeof(int);
+  value.length = strnlen(value.data, RecordFile::MAX_VALUE_LENGTH);
 }
 
 static void writeSlot(char* page, int n, int key, const std::string& value)
@@ -267,7 +977,9 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
   // store the key
   memcpy(ptr, &key, sizeof(int));
 
-  // store the value. 
+  // store the value. the rest of the slot is cleared, so that the
+  // last byte is the NUL that tells a live slot from a tombstone
+  memset(ptr + sizeof(int), 0, RecordFile::MAX_VALUE_LENGTH);
   if ((int)value.size() >= RecordFile::MAX_VALUE_LENGTH) {
     // when the string is longer than MAX_VALUE_LENGTH, truncate it.
     memcpy(ptr + sizeof(int), value.c_str(), RecordFile::MAX_VALUE_LENGTH -1);
@@ -276,3 +988,71 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
     strcpy(ptr + sizeof(int), value.c_str());
   }
 }
+
+static void readSlotted(const char* page, int n, int& key, ValueView& value)
+{
+  Slot slot;
+  memcpy(&slot, page + SLOTTED_HEADER + n * sizeof(Slot), sizeof(Slot));
+
+  // read the key and the value that follows it
+  memcpy(&key, page + slot.offset, sizeof(int));
+  value.data = page + slot.offset + sizeof(int);
+  value.length = slot.length - sizeof(int);
+}
+
+static bool appendSlotted(char* page, int pageSize, int n, int key, const std::string& value)
+{
+  // the records start at the end of an empty page
+  int start;
+  memcpy(&start, page + sizeof(int), sizeof(int));
+  if (start == 0) start = pageSize;
+
+  // a value is truncated as in a fixed slot, and ends at its first NUL
+  int length = strlen(value.c_str());
+  if (length >= RecordFile::MAX_VALUE_LENGTH) length = RecordFile::MAX_VALUE_LENGTH - 1;
+  int size = sizeof(int) + length;
+
+  // the record and its slot must fit between the directory and the records
+  int directoryEnd = SLOTTED_HEADER + (n + 1) * sizeof(Slot);
+  if (start - size < directoryEnd) return false;
+
+  start -= size;
+  memcpy(page + start, &key, sizeof(int));
+  memcpy(page + start + sizeof(int), value.c_str(), length);
+
+  Slot slot;
+  slot.offset = start;
+  slot.length = size;
+  memcpy(page + SLOTTED_HEADER + n * sizeof(Slot), &slot, sizeof(Slot));
+  memcpy(page + sizeof(int), &start, sizeof(int));
+  return true;
+}
+
+static bool updateSlotted(char* page, int n, int key, const std::string& value)
+{
+  Slot slot;
+  memcpy(&slot, page + SLOTTED_HEADER + n * sizeof(Slot), sizeof(Slot));
+
+  // a value is truncated as in a fixed slot, and ends at its first NUL
+  int length = strlen(value.c_str());
+  if (length >= RecordFile::MAX_VALUE_LENGTH) length = RecordFile::MAX_VALUE_LENGTH - 1;
+  int size = sizeof(int) + length;
+
+  // a longer record goes to the free space between the directory and
+  // the records. its old space is reclaimed by compaction
+  if (size > slot.length) {
+    int start;
+    memcpy(&start, page + sizeof(int), sizeof(int));
+    int directoryEnd = SLOTTED_HEADER + getRecordCount(page) * sizeof(Slot);
+    if (start - size < directoryEnd) return false;
+    start -= size;
+    slot.offset = start;
+    memcpy(page + sizeof(int), &start, sizeof(int));
+  }
+
+  memcpy(page + slot.offset, &key, sizeof(int));
+  memcpy(page + slot.offset + sizeof(int), value.c_str(), length);
+  slot.length = size;
+  memcpy(page + SLOTTED_HEADER + n * sizeof(Slot), &slot, sizeof(Slot));
+  return true;
+}
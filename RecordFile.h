@@ -10,8 +10,13 @@
 #ifndef RECORDFILE_H
 #define RECORDFILE_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <vector>
+#include "BufferPool.h"
 #include "PageFile.h"
+#include "PageReadBatch.h"
 
 /**
  * The data structure for pointing to a particular record in a RecordFile.
@@ -26,10 +31,6 @@ typedef struct {
 // helper functions for RecordId
 // 
 
-// RecordId iterators
-RecordId& operator++ (RecordId& rid);
-RecordId  operator++ (RecordId& rid, int);
-
 // RecordId comparators
 bool operator> (const RecordId& r1, const RecordId& r2);
 bool operator< (const RecordId& r1, const RecordId& r2);
@@ -39,7 +40,52 @@ bool operator== (const RecordId& r1, const RecordId& r2);
 bool operator!= (const RecordId& r1, const RecordId& r2);
 
 /**
- * read/write a record to a file
+ * a record value read in place: it points into a page pinned in the
+ * buffer pool, and is valid only as long as the page stays pinned
+ * (see RecordFile::read()). the value is not NUL-terminated.
+ */
+struct ValueView {
+  const char* data;  // the first byte of the value
+  int length;        // # bytes of the value
+
+  ValueView() : data(""), length(0) {}
+
+  /**
+   * compare the value with a NUL-terminated string like strcmp() does.
+   * @return <0, 0 or >0 if the value is less than, equal to or
+   *         greater than s
+   */
+  int compare(const char* s) const;
+
+  /**
+   * @return a copy of the value
+   */
+  std::string str() const { return std::string(data, length); }
+};
+
+/**
+ * read/write a record to a file.
+ * a file stores its records in one of three formats, chosen when the file
+ * is created and recorded in its header:
+ *   FIXED_SLOTS: every record takes a slot of sizeof(int) +
+ *     MAX_VALUE_LENGTH bytes, so a 1KB page holds 9 records.
+ *   SLOTTED: a page has a directory of slots at its start and the
+ *     records, each a key and a value of its own length, packed at its
+ *     end. a page holds as many records as fit, so a table of short
+ *     values takes a fraction of the pages.
+ *   COLUMNAR: the keys and the values are stored apart. the file holds
+ *     only the keys, 247 to a 1KB page, and the file <filename>.val
+ *     holds the values in slots of MAX_VALUE_LENGTH bytes. the n'th
+ *     key and the n'th value make a record, so a scan that needs only
+ *     the keys (see readKey()) never reads the values.
+ * a record can be rewritten in place with update(). a deleted record
+ * leaves a tombstone in its slot, which read() and RecordScan skip,
+ * so the records after it keep their ids. the space of the deleted
+ * records is reclaimed only by copying the live records to a new file.
+ * every file has a zone map, the file <filename>.zm, with the smallest
+ * and the largest key of every page. a scan for a range of keys (see
+ * RecordScan::setKeyRange()) skips the pages whose keys are all out of
+ * the range without reading them.
  */
 class RecordFile {
  public:
@@ -47,22 +93,32 @@ class RecordFile {
   // maximum length of the value field
   static const int MAX_VALUE_LENGTH = 100;  
 
-  // number of record slots per page
-  static const int RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int))/ (sizeof(int) + MAX_VALUE_LENGTH);  
-    // Note that we subtract sizeof(int) from PAGE_SIZE because the first
-    // four bytes in the page is used to store # records in the page.
+  //
+  // record formats
+  //
+  enum Format {
+    FIXED_SLOTS = 0,
+    SLOTTED = 1,
+    COLUMNAR = 2
+  };
 
   RecordFile();
-  RecordFile(const std::string& filename, char mode);
+  RecordFile(const std::string& filename, char mode, int flags = 0,
+             int pageSize = PageFile::PAGE_SIZE, Format format = FIXED_SLOTS);
   
   /**
    * open a file in read or write mode.
    * when opened in 'w' mode, if the file does not exist, it is created.
    * @param filename[IN] the name of the file to open
    * @param mode[IN] 'r' for read, 'w' for write
+   * @param flags[IN] PageFile option flags (e.g., PageFile::WRITE_BACK)
+   * @param pageSize[IN] the page size of the file if it is created
+   * @param format[IN] the record format of the file if it is created.
+   *                   an existing file keeps its format
    * @return error code. 0 if no error
    */
-  RC open(const std::string& filename, char mode);
+  RC open(const std::string& filename, char mode, int flags = 0,
+          int pageSize = PageFile::PAGE_SIZE, Format format = FIXED_SLOTS);
 
   /**
    * close the file.
@@ -70,19 +126,54 @@ class RecordFile {
    */
   RC close();
 
+  /**
+   * make the records appended so far durable (see PageFile::commit()).
+   * @return error code. 0 if no error
+   */
+  RC commit();
+
   /**
    * read a record from the file. note that every record is a (key, value) pair.
    * @param rid[IN] the id of the record to read
    * @param key[OUT] the record key
    * @param value[OUT] the record valu
-   * @return error code. 0 if no error
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the record
+   *         is deleted
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * read a record without copying its value. the value points into the
+   * page pinned by guard, so nothing is allocated or copied.
+   * @param rid[IN] the id of the record to read
+   * @param key[OUT] the record key
+   * @param value[OUT] the record value, valid while guard holds the pin
+   * @param guard[OUT] the pin of the page holding the value. the pin
+   *                   it held before is released
+   * @return error code. 0 if no error
+   */
+  RC read(const RecordId& rid, int& key, ValueView& value, PageGuard& guard) const;
+
+  /**
+   * read only the key of a record. in a COLUMNAR file, the value
+   * column is not read at all.
+   * @param rid[IN] the id of the record to read
+   * @param key[OUT] the record key
+   * @return error code. 0 if no error
+   */
+  RC readKey(const RecordId& rid, int& key) const;
+
+  /**
+   * bring the pages holding the given records into the buffer pool
+   * with one batch of asynchronous reads, so that the following read()
+   * calls for these records do not wait for the disk one by one.
+   * @param rids[IN] the records that will be read soon
+   * @return error code. 0 if no error
+   */
+  RC prefetch(const std::vector<RecordId>& rids);
+
   /**
    * append a new record at the end of the file.
-   * note that RecordFile does not have write() function.
-   * append is the only way to write a record to a RecordFile.
    * @param key[IN] the record key
    * @param value[IN] the record value
    * @param rid[OUT] the location of the stored record
@@ -90,15 +181,238 @@ class RecordFile {
    */
   RC append(int key, const std::string& value, RecordId& rid);
 
+  /**
+   * append records at the end of the file, a page at a time. a page is
+   * filled in memory and written once, instead of once per record as
+   * append() does.
+   * @param keys[IN] the record keys
+   * @param values[IN] the record values, as many as keys
+   * @param rids[OUT] the locations of the stored records
+   * @return error code. 0 if no error
+   */
+  RC appendBatch(const std::vector<int>& keys, const std::vector<std::string>& values,
+                 std::vector<RecordId>& rids);
+
+  /**
+   * @return # page writes issued by append() and appendBatch() since
+   *         the file was opened
+   */
+  long long getAppendWrites() const { return appendWrites; }
+
+  /**
+   * rewrite a record in place. a record of a SLOTTED file that no
+   * longer fits in its page is deleted and appended at the end of the
+   * file instead, and rid is set to its new location.
+   * @param rid[IN/OUT] the id of the record to rewrite
+   * @param key[IN] the new key
+   * @param value[IN] the new value
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the record
+   *         is deleted
+   */
+  RC update(RecordId& rid, int key, const std::string& value);
+
+  /**
+   * delete a record by leaving a tombstone in its slot.
+   * @param rid[IN] the id of the record to delete
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the record
+   *         is already deleted
+   */
+  RC remove(const RecordId& rid);
+
   /**
    * note the +1 part. The rid of the last record is endRid()-1.
    * @return (last record id + 1) of the RecordFile
    */
   const RecordId& endRid() const;
 
+  /**
+   * move the record id to the next record slot of the file.
+   * if the end of a page is reached, it moves to the first slot of
+   * the next page.
+   * @param rid[IN/OUT] the record id to advance
+   */
+  void nextRid(RecordId& rid) const;
+
+  /**
+   * @return the max # of records in a page of the file
+   */
+  int getRecordsPerPage() const { return recordsPerPage; }
+
+  /**
+   * @return the record format of the file
+   */
+  Format getFormat() const { return format; }
+
+  /**
+   * @return the page size of the file
+   */
+  int getPageSize() const { return pf.getPageSize(); }
+
+  /**
+   * @return true if the pages of the file are compressed
+   */
+  bool isCompressed() const { return pf.isCompressed(); }
+
+  /**
+   * check the zone map for whether a page may hold keys in a range.
+   * the keys of deleted records count, and a page the zone map does
+   * not cover may hold any key.
+   * @param pid[IN] the page to check
+   * @param low[IN] the smallest key of the range
+   * @param high[IN] the largest key of the range
+   * @return false if no record of the page has a key in the range
+   */
+  bool mayHaveKeys(PageId pid, int low, int high) const;
+
+  /**
+   * rename a closed record file, together with its value column and
+   * zone map. each file is replaced atomically, so a reader that has
+   * the old file open goes on reading it.
+   * @param from[IN] the name of the file
+   * @param to[IN] the new name of the file
+   * @return error code. 0 if no error
+   */
+  static RC renameFile(const std::string& from, const std::string& to);
+
+  /**
+   * delete a closed record file, its value column and its zone map,
+   * if they exist.
+   * @param filename[IN] the name of the file
+   */
+  static void removeFile(const std::string& filename);
+
  private:
+  /**
+   * @return # records in page pid of a SLOTTED file. 0 if the page
+   *         cannot be read
+   */
+  int recordCount(PageId pid) const;
+
+  /**
+   * read the value of the record at rid from the value column of a
+   * COLUMNAR file into the page pinned by guard
+   */
+  RC readValue(const RecordId& rid, ValueView& value, PageGuard& guard) const;
+
+  /**
+   * append n records, writing every page they fill once
+   */
+  RC appendRecords(const int* keys, const std::string* values, int n, RecordId* rids);
+
+  /**
+   * write a page filled by appendRecords() and count the write
+   */
+  RC writeAppended(PageFile& file, PageId pid, const char* page);
+
+  /**
+   * open the zone map of the file. in 'w' mode, the zones are read, and
+   * the zones of the pages it does not cover yet are computed from the
+   * pages. in 'r' mode, the zones are read when a scan first needs them
+   */
+  RC openZoneMap(const std::string& filename, char mode, int flags);
+
+  /**
+   * read the zones from the zone map once
+   */
+  void readZones() const;
+
+  /**
+   * add the key of the record at rid to the zone of its page. the first
+   * record of a page starts a new zone
+   */
+  void addToZone(const RecordId& rid, int key);
+
+  /**
+   * write the page of the zone map that holds the zone of page pid
+   */
+  RC writeZone(PageId pid);
+
+  // the smallest and the largest key in a page
+  struct Zone {
+    int min;
+    int max;
+  };
+
   PageFile pf;     // the PageFile used to store the records
+                   // (only the keys in a COLUMNAR file)
+  PageFile vf;     // the value column of a COLUMNAR file
+  PageFile zf;     // the zone map
+  bool zoned;      // true if the zone map is open
+  mutable std::vector<Zone> zones; // the zone of every page the zone map covers
+  mutable std::atomic<bool> zonesRead; // true once zones are read
+  mutable std::mutex zoneLatch;  // serializes the reading of the zones
   RecordId erid;   // the last record id of the file + 1
+  int recordsPerPage; // # of record slots per page (the max # for SLOTTED)
+  int valuesPerPage;  // # of value slots per page of the value column
+  long long appendWrites; // # page writes issued by appends
+  Format format;   // the record format of the file
+
+  // the record count of the page nextRid() last looked at in a SLOTTED
+  // file, as (pid << 32 | count). -1 if none
+  mutable std::atomic<long long> countCache;
+
+  PageReadBatch batch;  // the asynchronous reads issued by prefetch()
+
+  friend class RecordScan;
+};
+
+/**
+ * a sequential scan of the records of a RecordFile, a page at a time.
+ * a page is pinned once and all its records are read from it in place,
+ * instead of looking the page up in the buffer pool for every record.
+ * in a COLUMNAR file, the values are pinned a page at a time as well,
+ * and only when a value is asked for.
+ */
+class RecordScan {
+ public:
+  /**
+   * start a scan at the first record of the file.
+   * @param rf[IN] an open RecordFile that outlives the scan
+   */
+  RecordScan(const RecordFile& rf);
+
+  /**
+   * read the next record of the file.
+   * @param rid[OUT] the id of the record
+   * @param key[OUT] the record key
+   * @param value[OUT] the record value. it points into a page pinned by
+   *                   the scan and is valid until the next call
+   * @return error code. 0 if no error. RC_END_OF_SCAN after the last record
+   */
+  RC next(RecordId& rid, int& key, ValueView& value);
+
+  /**
+   * read only the key of the next record (see RecordFile::readKey()).
+   * @param rid[OUT] the id of the record
+   * @param key[OUT] the record key
+   * @return error code. 0 if no error. RC_END_OF_SCAN after the last record
+   */
+  RC nextKey(RecordId& rid, int& key);
+
+  /**
+   * skip the pages that the zone map of the file rules out for a range
+   * of keys. the records of the other pages are all returned, whether
+   * their keys are in the range or not.
+   * @param low[IN] the smallest key of the range
+   * @param high[IN] the largest key of the range
+   */
+  void setKeyRange(int low, int high) { this->low = low; this->high = high; }
+
+ private:
+  // pin the page of the next record, moving on to the next page
+  // when the records of the current one are exhausted
+  RC fetch();
+
+  const RecordFile& rf;
+  RecordId  cursor;     // the next record
+  PageGuard page;       // the page of the cursor (of the keys if COLUMNAR)
+  int       count;      // # records in the page
+  PageGuard valuePage;  // the page of the last value read if COLUMNAR
+  int       low;        // the range of keys set by setKeyRange()
+  int       high;
+
+  RecordScan(const RecordScan&);
+  RecordScan& operator=(const RecordScan&);
 };
 
 #endif // RECORDFILE_H
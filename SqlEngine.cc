@@ -7,14 +7,23 @@
  * @date 3/24/2008
  */
 
+#include <algorithm>
+#include <climits>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
+#include "BloomFilter.h"
 #include "BTreeIndex.h"
+#include "ValueIndex.h"
+#include "BufferPool.h"
+#include "WriteAheadLog.h"
 
 using namespace std;
 
@@ -22,6 +31,85 @@ using namespace std;
 extern FILE* sqlin;
 int sqlparse(void);
 
+int SqlEngine::readFlags = 0;
+int SqlEngine::pageSize = PageFile::PAGE_SIZE;
+RecordFile::Format SqlEngine::recordFormat = RecordFile::FIXED_SLOTS;
+
+// # tuples LOAD appends to the table at a time
+static const int LOAD_BATCH_SIZE = 1000;
+
+// the suffix of the files COMPACT and CREATE INDEX write before they
+// replace the old files
+static const char* COMPACT_SUFFIX = ".compact";
+
+// the suffix of the file that holds the Bloom filters of a table
+static const char* FILTER_SUFFIX = ".bf";
+
+// the suffix of the index on the values of a table
+static const char* VALUE_INDEX_SUFFIX = ".vidx";
+
+// the Bloom filters of a table, on its keys and on its values
+struct TableFilters {
+  BloomFilter keys;
+  BloomFilter values;
+  struct stat file;  // the file the filters were read from
+};
+
+// the filters read so far, by table name, so that a query does not
+// read the filters of its table again
+static std::map<string, TableFilters> filterCache;
+
+// get the Bloom filters of a table. NULL if it has none
+static const TableFilters* readFilters(const string& table);
+
+// build the Bloom filters of a table from the hashes of its keys and
+// values, and write them. the old filters are replaced atomically
+static RC writeFilters(const string& table, const vector<unsigned long long>& keyHashes,
+                       const vector<unsigned long long>& valueHashes);
+
+// write the Bloom filters of a table
+static RC writeFilters(const string& table, TableFilters& filters);
+
+// delete the Bloom filters of a table. a table without filters is read
+// as it is, so the filters are deleted before a change that they would miss
+static void dropFilters(const string& table);
+
+// the value as the table stores it
+static string storedValue(const string& value);
+
+// add the hashes of a tuple's key and value, as the table stores the
+// value, to the lists
+static void addHashes(int key, const string& value, vector<unsigned long long>& keyHashes,
+                      vector<unsigned long long>& valueHashes);
+
+// check the Bloom filters of the table for whether any tuple may
+// satisfy the equality conditions
+static bool mayMatch(const string& table, const vector<SelCond>& cond);
+
+// compute the range of keys that the conditions allow.
+// return false if no key satisfies the conditions
+static bool keyRange(const vector<SelCond>& cond, int& low, int& high);
+
+// compute the range of values that the conditions allow.
+// return false if no condition bounds the value
+static bool valueRange(const vector<SelCond>& cond, string& low, string& high);
+
+// check whether a tuple satisfies all conditions
+static bool satisfies(int key, const ValueView& value, const vector<SelCond>& cond);
+
+// collect the tuples of the table that satisfy all conditions. the
+// key index is used when the conditions restrict the key, and the value
+// index when they restrict only the value
+static RC findTuples(const RecordFile& rf, BTreeIndex<int>& tree, ValueIndex& vtree,
+                     const vector<SelCond>& cond, vector<int>& keys, vector<RecordId>& rids);
+
+// open the table and its indexes for UPDATE and DELETE
+static RC openForWrite(const string& table, int readFlags, RecordFile& rf, BTreeIndex<int>& tree,
+                       ValueIndex& vtree);
+
+// commit the changes of UPDATE and DELETE if the files are logged, and close the files
+static RC closeForWrite(int readFlags, RecordFile& rf, BTreeIndex<int>& tree, ValueIndex& vtree);
+
 
 RC SqlEngine::run(FILE* commandline)
 {
@@ -138,25 +226,37 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     RecordFile rf;   // RecordFile containing the table
     RecordId   rid;  // record cursor for table scanning
 
-    BTreeIndex tree;
-    int errortree = tree.open(table + ".idx", 'r');
-
-
+    BTreeIndex<int> tree;
     IndexCursor cursor;
 
 
     RC     rc;
     int    key;
-    string value;
+    // the value of a tuple points into its page, which the guard keeps
+    // pinned, so a tuple is read without copying or allocating anything
+    ValueView value;
+    PageGuard guard;
     int    count;
     int    diff;
 
     // open the table file
-    if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
+    if ((rc = rf.open(table + ".tbl", 'r', readFlags)) < 0) {
         fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
         return rc;
     }
 
+    // a key or a value that the Bloom filters of the table rule out
+    // matches no tuple, and neither the indexes nor the table are read
+    if (!mayMatch(table, cond)) {
+        if (attr == 4) {
+            fprintf(stdout, "0\n");
+        }
+        rf.close();
+        return 0;
+    }
+
+    int errortree = tree.open(table + ".idx", 'r', readFlags);
+
     //scan the table by b+index tree
 
     int min=-1;
@@ -223,84 +323,191 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
 
     }
 
+    // the index on the values serves the conditions on the value, unless
+    // a key is looked up by equality, which the key index does faster
+    ValueIndex vtree;
+    string vlow, vhigh;
+    bool useValueIndex = false;
+    bool keyequal = false;
+    for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr == 1 && cond[i].comp == SelCond::EQ) keyequal = true;
+    }
+    if (!keyequal && valueRange(cond, vlow, vhigh) &&
+        vtree.open(table + VALUE_INDEX_SUFFIX, 'r', readFlags) == 0) {
+        useValueIndex = vtree.getTreeHeight() > 0;
+    }
 
 
-    if (errortree==0 && useBindextree){
-        //cout<< "using Bindex tree now"<<endl;
-        if (couldminequal){
-            tree.locate(min,cursor);
-        }
-        else{
-            tree.locate(min+1,cursor);
+    if (useValueIndex){
+        // the entries of the value index hold the values, so the table
+        // is read only when the query needs the keys
+        bool needkey = (attr == 1 || attr == 3);
+        for (unsigned i = 0; i < cond.size(); i++) {
+            if (cond[i].attr == 1) needkey = true;
         }
-        int tmpcount=0;
-        count = 0;
-        while(tree.readForward(cursor, key, rid)==0){
 
-            if (max!=-1 && ((key>max && couldmaxequal) ||(key>=max && !couldmaxequal))){
-                break;
+        vtree.locate(vlow, cursor);
+        count = 0;
 
-            }
-            if (needread){
-                rc = rf.read(rid, key, value);
-                if (rc<0) {
-                    fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-                    continue;
+        // the table pages of a batch of entries are read asynchronously
+        // all at once, as with the key index
+        vector<string>   values;
+        vector<RecordId> rids;
+        bool endofscan = false;
+        while (!endofscan){
+            values.clear();
+            rids.clear();
+            string v;
+            while ((int)rids.size() < PageReadBatch::QUEUE_DEPTH){
+                if (vtree.readForward(cursor, v, rid) != 0 || v.compare(vhigh) > 0){
+                    endofscan = true;
+                    break;
                 }
+                values.push_back(v);
+                rids.push_back(rid);
             }
 
+            if (needkey){
+                rf.prefetch(rids);
+            }
 
-            for (unsigned i = 0; i < cond.size(); i++) {
-                // compute the difference between the tuple value and the condition value
-                switch (cond[i].attr) {
-                    case 1:
-                        diff = key - atoi(cond[i].value);
-                        break;
-                    case 2:
-                        diff = strcmp(value.c_str(), cond[i].value);
-                        break;
+            for (unsigned j = 0; j < rids.size(); j++) {
+                if (needkey){
+                    if (rf.read(rids[j], key, value, guard) < 0) {
+                        fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+                        continue;
+                    }
                 }
+                else{
+                    value.data = values[j].data();
+                    value.length = values[j].size();
+                }
+                if (!satisfies(key, value, cond)) continue;
 
-                // skip the tuple if any condition is not met
-                switch (cond[i].comp) {
-                    case SelCond::EQ:
-                        if (diff != 0) goto next_key;
+                count++;
+                // print the tuple
+                switch (attr) {
+                    case 1:  // SELECT key
+                        fprintf(stdout, "%d\n", key);
                         break;
-                    case SelCond::NE:
-                        if (diff == 0) goto next_key;
-                        break;
-                    case SelCond::GT:
-                        if (diff <= 0) goto next_key;
-                        break;
-                    case SelCond::LT:
-                        if (diff >= 0) goto next_key;
-                        break;
-                    case SelCond::GE:
-                        if (diff < 0) goto next_key;
+                    case 2:  // SELECT value
+                        fprintf(stdout, "%.*s\n", value.length, value.data);
                         break;
-                    case SelCond::LE:
-                        if (diff > 0) goto next_key;
+                    case 3:  // SELECT *
+                        fprintf(stdout, "%d '%.*s'\n", key, value.length, value.data);
                         break;
                 }
             }
-            count++;
-            // print the tuple
-            switch (attr) {
-                case 1:  // SELECT key
-                    fprintf(stdout, "%d\n", key);
+        }
+
+        if (attr == 4) {
+            fprintf(stdout, "%d\n", count);
+        }
+        rc = 0;
+
+    }
+    else if (errortree==0 && useBindextree && tree.treeHeight>0){
+        //cout<< "using Bindex tree now"<<endl;
+        if (couldminequal){
+            tree.locate(min,cursor);
+        }
+        else{
+            tree.locate(min+1,cursor);
+        }
+        count = 0;
+
+        // the index entries are processed in batches. the table pages of
+        // a batch are read asynchronously all at once, so we do not wait
+        // for the disk once per tuple
+        vector<int>      keys;
+        vector<RecordId> rids;
+        bool endofscan = false;
+        while (!endofscan){
+            keys.clear();
+            rids.clear();
+            while ((int)rids.size() < PageReadBatch::QUEUE_DEPTH){
+                if (tree.readForward(cursor, key, rid)!=0){
+                    endofscan=true;
                     break;
-                case 2:  // SELECT value
-                    fprintf(stdout, "%s\n", value.c_str());
+                }
+                if (max!=-1 && ((key>max && couldmaxequal) ||(key>=max && !couldmaxequal))){
+                    endofscan=true;
                     break;
-                case 3:  // SELECT *
-                    fprintf(stdout, "%d '%s'\n", key, value.c_str());
+                }
+                keys.push_back(key);
+                rids.push_back(rid);
+                if (cursor.pid==0){
+                    endofscan=true;
                     break;
+                }
+            }
+
+            // a failed prefetch shows up again in rf.read() below
+            if (needread){
+                rf.prefetch(rids);
             }
 
+            for (unsigned j = 0; j < rids.size(); j++) {
+                key = keys[j];
+                rid = rids[j];
+                if (needread){
+                    rc = rf.read(rid, key, value, guard);
+                    if (rc<0) {
+                        fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+                        continue;
+                    }
+                }
+
+                for (unsigned i = 0; i < cond.size(); i++) {
+                    // compute the difference between the tuple value and the condition value
+                    switch (cond[i].attr) {
+                        case 1:
+                            diff = key - atoi(cond[i].value);
+                            break;
+                        case 2:
+                            diff = value.compare(cond[i].value);
+                            break;
+                    }
+
+                    // skip the tuple if any condition is not met
+                    switch (cond[i].comp) {
+                        case SelCond::EQ:
+                            if (diff != 0) goto next_key;
+                            break;
+                        case SelCond::NE:
+                            if (diff == 0) goto next_key;
+                            break;
+                        case SelCond::GT:
+                            if (diff <= 0) goto next_key;
+                            break;
+                        case SelCond::LT:
+                            if (diff >= 0) goto next_key;
+                            break;
+                        case SelCond::GE:
+                            if (diff < 0) goto next_key;
+                            break;
+                        case SelCond::LE:
+                            if (diff > 0) goto next_key;
+                            break;
+                    }
+                }
+                count++;
+                // print the tuple
+                switch (attr) {
+                    case 1:  // SELECT key
+                        fprintf(stdout, "%d\n", key);
+                        break;
+                    case 2:  // SELECT value
+                        fprintf(stdout, "%.*s\n", value.length, value.data);
+                        break;
+                    case 3:  // SELECT *
+                        fprintf(stdout, "%d '%.*s'\n", key, value.length, value.data);
+                        break;
+                }
 
-            next_key:
-        tmpcount++;
-            if (cursor.pid==0) break;
+                next_key:
+                ;
+            }
         }
 
 
@@ -312,12 +519,23 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     }
     else{
         //cout<< "full scan the recode file "<<endl;
-        // scan the table file from the beginning
-        rid.pid = rid.sid = 0;
+        // scan the table file from the beginning. the scan pins each
+        // page once and reads all of its tuples in place, and skips the
+        // pages whose keys the zone map rules out
+        RecordScan scan(rf);
+        int low, high;
+        if (keyRange(cond, low, high)) {
+            scan.setKeyRange(low, high);
+        } else {
+            scan.setKeyRange(INT_MAX, INT_MIN);
+        }
         count = 0;
-        while (rid < rf.endRid()) {
-            // read the tuple
-            if ((rc = rf.read(rid, key, value)) < 0) {
+        for (;;) {
+            // read the tuple. when the query needs only the key, only the
+            // key is read, and a COLUMNAR table never reads its values
+            rc = needread ? scan.next(rid, key, value) : scan.nextKey(rid, key);
+            if (rc == RC_END_OF_SCAN) break;
+            if (rc < 0) {
                 fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
                 goto exit_select;
             }
@@ -330,7 +548,7 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
                         diff = key - atoi(cond[i].value);
                         break;
                     case 2:
-                        diff = strcmp(value.c_str(), cond[i].value);
+                        diff = value.compare(cond[i].value);
                         break;
                 }
 
@@ -367,16 +585,16 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
                     fprintf(stdout, "%d\n", key);
                     break;
                 case 2:  // SELECT value
-                    fprintf(stdout, "%s\n", value.c_str());
+                    fprintf(stdout, "%.*s\n", value.length, value.data);
                     break;
                 case 3:  // SELECT *
-                    fprintf(stdout, "%d '%s'\n", key, value.c_str());
+                    fprintf(stdout, "%d '%.*s'\n", key, value.length, value.data);
                     break;
             }
 
             // move to the next tuple
             next_tuple:
-            ++rid;
+            ;
         }
 
         // print matching tuple count if "select count(*)"
@@ -394,7 +612,9 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     // close the table file and return
     exit_select:
 
-
+    // the last tuple read keeps its page pinned until here
+    guard.release();
+    vtree.close();
     rf.close();
     return rc;
 }
@@ -410,46 +630,163 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
     
     int key;
     string value;
-    RecordId rid;
-    BTreeIndex tree;
+    BTreeIndex<int> tree;
     
     
     string tablename = std::string(table)+".tbl";
     RecordFile rf;
 
     std::ifstream myfile(loadfile.c_str());
-    rf.open(tablename.c_str(),'w');
+    // buffer the page writes of the load in the buffer pool.
+    // a page is written to disk once when it is evicted or at close().
+    // with LOGGED, the writes are logged and committed at the end
+    int flags = PageFile::WRITE_BACK | (readFlags & (PageFile::DIRECT|PageFile::LOGGED));
+    if ((rc = rf.open(tablename.c_str(),'w',flags | (readFlags & PageFile::COMPRESS),pageSize,recordFormat)) < 0) {
+        fprintf(stderr, "Error: while loading table %s\n", table.c_str());
+        return rc;
+    }
 
     string line;
 
-    tree.open(table + ".idx", 'w');
+    if ((rc = tree.open(table + ".idx", 'w', flags, pageSize)) < 0) {
+        fprintf(stderr, "Error: while loading table %s\n", table.c_str());
+        rf.close();
+        return rc;
+    }
+
+    // a table that already has an index on its keys keeps it up to date
+    // as well, with or without WITH INDEX
+    bool keyindex = index || tree.treeHeight > 0;
+
+    // a table that has an index on its values keeps it up to date
+    ValueIndex vtree;
+    bool valueindex = ::access((table + VALUE_INDEX_SUFFIX).c_str(), F_OK) == 0;
+    if (valueindex && (rc = vtree.open(table + VALUE_INDEX_SUFFIX, 'w', flags, pageSize)) < 0){
+        fprintf(stderr, "Error: while loading table %s\n", table.c_str());
+        tree.close();
+        rf.close();
+        return rc;
+    }
+
+    // the Bloom filters of the table are put aside, and written back with
+    // the loaded keys and values once the load is committed. until then
+    // the table has none, so that a crash does not leave filters that
+    // miss the loaded tuples
+    TableFilters filters;
+    vector<unsigned long long> keyHashes;
+    vector<unsigned long long> valueHashes;
+    const TableFilters* old = readFilters(table);
+    bool rebuild = (old == NULL);
+    if (old != NULL) filters = *old;
+    dropFilters(table);
 
     int count=0;
 
-    while ( getline (myfile,line) )
+    // the tuples are appended in batches, so that a table page is
+    // filled in memory and written once instead of once per tuple
+    vector<int>      keys;
+    vector<string>   values;
+    vector<RecordId> rids;
+    long long tuples = 0;
+    bool endoffile = false;
+
+    // the first error stops the load. the tuples of a failed batch have
+    // no RecordIds, so nothing after it can be indexed or filtered
+    while (!endoffile && rc >= 0)
     {
-
-        if ((rc= parseLoadLine(line,key,value))<0 ){
-            fprintf(stderr, "error");
+        keys.clear();
+        values.clear();
+        while ((int)keys.size() < LOAD_BATCH_SIZE) {
+            if (!getline(myfile,line)) {
+                endoffile = true;
+                break;
+            }
+            if ((rc= parseLoadLine(line,key,value))<0 ){
+                fprintf(stderr, "error");
+            }
+            keys.push_back(key);
+            values.push_back(value);
         }
-        if ((rc=rf.append(key,value,rid))<0){
-            fprintf(stderr, "error1" );
+        if ((rc=rf.appendBatch(keys,values,rids))<0){
+            break;
+        }
+        tuples += keys.size();
+        for (unsigned i = 0; i < keys.size(); i++) {
+            addHashes(keys[i], values[i], keyHashes, valueHashes);
         }
 
-        if (index){
-
-            if ((tree.insert(key, rid))<0){
-                return RC_FILE_WRITE_FAILED;
+        if (keyindex){
+            for (unsigned i = 0; i < rids.size(); i++) {
+                if ((rc = tree.insert(keys[i], rids[i]))<0){
+                    break;
+                }
+                count++;
+            }
+        }
+        if (valueindex && rc >= 0){
+            for (unsigned i = 0; i < rids.size(); i++) {
+                if ((rc = vtree.insert(storedValue(values[i]), rids[i]))<0){
+                    break;
+                }
             }
-            count++;
-           // cout<< "tuple number: "<< key <<endl;
         }
         
     }
+
+    if (rc < 0) {
+        fprintf(stderr, "Error: while loading table %s\n", table.c_str());
+        tree.close();
+        if (valueindex) vtree.close();
+        rf.close();
+        return rc;
+    }
+
+    // the write amplification of the table: with one write per tuple,
+    // every page would have been written once per record it holds
+    if (rf.getAppendWrites() > 0) {
+        fprintf(stdout, "%s: %lld tuples appended with %lld page writes (%.1f tuples per write)\n",
+                tablename.c_str(), tuples, rf.getAppendWrites(),
+                (double)tuples / rf.getAppendWrites());
+    }
     tree.print();
+    if (readFlags & PageFile::LOGGED) {
+        if (keyindex && (rc = tree.commit()) < 0) return rc;
+        if (valueindex && (rc = vtree.commit()) < 0) return rc;
+        if ((rc = rf.commit()) < 0) return rc;
+    }
+
+    // the loaded tuples are added to the old filters, unless the table
+    // has none or they would hold more entries than they were sized for.
+    // the filters are then rebuilt from all tuples of the table, sized
+    // for twice as many, so that the next loads only add to them
+    if (!rebuild) {
+        long long entries = (long long)keyHashes.size();
+        rebuild = filters.keys.estimateEntries() + entries > filters.keys.getCapacity() ||
+                  filters.values.estimateEntries() + entries > filters.values.getCapacity();
+    }
+    if (rebuild) {
+        keyHashes.clear();
+        valueHashes.clear();
+        RecordScan scan(rf);
+        ValueView v;
+        RecordId r;
+        while (scan.next(r, key, v) == 0) {
+            addHashes(key, v.str(), keyHashes, valueHashes);
+        }
+    }
     tree.close();
+    if (valueindex) vtree.close();
     rf.close();
     myfile.close();
+    if (rebuild) {
+        filters.keys.reset(2 * (long long)keyHashes.size());
+        filters.values.reset(2 * (long long)valueHashes.size());
+    }
+    for (unsigned i = 0; i < keyHashes.size(); i++) {
+        filters.keys.add(keyHashes[i]);
+        filters.values.add(valueHashes[i]);
+    }
+    if ((rc = writeFilters(table, filters)) < 0) return rc;
     
 
     
@@ -457,6 +794,665 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
   return rc;
 }
 
+RC SqlEngine::update(const string& table, int attr, const char* value,
+                     const vector<SelCond>& cond)
+{
+  RC rc;
+  RecordFile rf;
+  BTreeIndex<int> tree;
+  ValueIndex vtree;
+  vector<int> keys;
+  vector<RecordId> rids;
+  int count = 0;
+
+  if (attr != 1 && attr != 2) {
+    fprintf(stderr, "Error: UPDATE can set the key or the value only\n");
+    return RC_INVALID_ATTRIBUTE;
+  }
+  if ((rc = openForWrite(table, readFlags, rf, tree, vtree)) < 0) return rc;
+
+  // find the tuples first, so that a tuple that moves to the end of the
+  // table is not found again
+  if ((rc = findTuples(rf, tree, vtree, cond, keys, rids)) < 0) {
+    fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+  }
+
+  // the Bloom filters of the table are put aside, and written back with
+  // the new keys and values once the changes are committed
+  TableFilters filters;
+  vector<unsigned long long> keyHashes;
+  vector<unsigned long long> valueHashes;
+  const TableFilters* old = rids.empty() ? NULL : readFilters(table);
+  if (old != NULL) {
+    filters = *old;
+    dropFilters(table);
+  }
+
+  for (unsigned i = 0; rc == 0 && i < rids.size(); i++) {
+    RecordId rid = rids[i];
+    int key;
+    string v;
+
+    // the attribute that is not set keeps its value
+    if ((rc = rf.read(rid, key, v)) < 0) break;
+    string oldvalue = v;
+    if (attr == 1) {
+      key = atoi(value);
+    } else {
+      v = storedValue(value);
+    }
+    if ((rc = rf.update(rid, key, v)) < 0) break;
+    addHashes(key, v, keyHashes, valueHashes);
+
+    // the index follows a tuple whose key changed or that moved.
+    // an index that missed the tuple has no entry to remove, which does
+    // not stop the statement halfway
+    if (tree.treeHeight > 0 && (key != keys[i] || rid != rids[i])) {
+      if ((rc = tree.remove(keys[i], rids[i])) < 0 && rc != RC_NO_SUCH_RECORD) break;
+      if ((rc = tree.insert(key, rid)) < 0) break;
+    }
+
+    // and so does the value index for a tuple whose value changed
+    if (vtree.getTreeHeight() > 0 && (v != oldvalue || rid != rids[i])) {
+      if ((rc = vtree.remove(oldvalue, rids[i])) < 0 && rc != RC_NO_SUCH_RECORD) break;
+      if ((rc = vtree.insert(v, rid)) < 0) break;
+    }
+    count++;
+  }
+  if (rc < 0) fprintf(stderr, "Error: while updating a tuple of table %s\n", table.c_str());
+
+  fprintf(stdout, "%d tuples updated\n", count);
+  RC rc2 = closeForWrite(readFlags, rf, tree, vtree);
+  if (old != NULL && rc2 == 0) {
+    for (unsigned i = 0; i < keyHashes.size(); i++) {
+      filters.keys.add(keyHashes[i]);
+      filters.values.add(valueHashes[i]);
+    }
+    rc2 = writeFilters(table, filters);
+  }
+  return (rc < 0) ? rc : rc2;
+}
+
+RC SqlEngine::remove(const string& table, const vector<SelCond>& cond)
+{
+  RC rc;
+  RecordFile rf;
+  BTreeIndex<int> tree;
+  ValueIndex vtree;
+  vector<int> keys;
+  vector<RecordId> rids;
+  int count = 0;
+
+  if ((rc = openForWrite(table, readFlags, rf, tree, vtree)) < 0) return rc;
+  if ((rc = findTuples(rf, tree, vtree, cond, keys, rids)) < 0) {
+    fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+  }
+
+  for (unsigned i = 0; rc == 0 && i < rids.size(); i++) {
+    // the entry of the tuple in the value index is found by its value.
+    // as in update(), an index that missed the tuple has nothing to remove
+    if (vtree.getTreeHeight() > 0) {
+      int key;
+      string v;
+      if ((rc = rf.read(rids[i], key, v)) < 0) break;
+      if ((rc = vtree.remove(v, rids[i])) < 0 && rc != RC_NO_SUCH_RECORD) break;
+    }
+    if ((rc = rf.remove(rids[i])) < 0) break;
+    if (tree.treeHeight > 0 && (rc = tree.remove(keys[i], rids[i])) < 0 && rc != RC_NO_SUCH_RECORD) break;
+    rc = 0;
+    count++;
+  }
+  if (rc < 0) fprintf(stderr, "Error: while deleting a tuple of table %s\n", table.c_str());
+
+  fprintf(stdout, "%d tuples deleted\n", count);
+  RC rc2 = closeForWrite(readFlags, rf, tree, vtree);
+  return (rc < 0) ? rc : rc2;
+}
+
+RC SqlEngine::compact(const string& table)
+{
+  RC rc;
+  RecordFile rf, newrf;
+  BTreeIndex<int> tree, newtree;
+  ValueIndex newvtree;
+  string tablename = table + ".tbl";
+  string indexname = table + ".idx";
+  string vindexname = table + VALUE_INDEX_SUFFIX;
+  string newtablename = tablename + COMPACT_SUFFIX;
+  string newindexname = indexname + COMPACT_SUFFIX;
+  string newvindexname = vindexname + COMPACT_SUFFIX;
+
+  if ((rc = rf.open(tablename, 'r', readFlags)) < 0) {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    return rc;
+  }
+
+  // only a table loaded WITH INDEX gets a new index. the new indexes
+  // keep the page sizes of the old ones
+  tree.open(indexname, 'r', readFlags);
+  bool index = tree.treeHeight > 0;
+  int indexPageSize = tree.pf.getPageSize();
+  tree.close();
+  bool valueindex = ::access(vindexname.c_str(), F_OK) == 0;
+  int vindexPageSize = pageSize;
+  if (valueindex) {
+    ValueIndex vtree;
+    if ((rc = vtree.open(vindexname, 'r', readFlags)) < 0) {
+      rf.close();
+      return rc;
+    }
+    vindexPageSize = vtree.getPageSize();
+    vtree.close();
+  }
+
+  // the new files are written like LOAD writes them, in the format of
+  // the table. the files of an interrupted COMPACT are thrown away
+  RecordFile::removeFile(newtablename);
+  ::unlink(newindexname.c_str());
+  ::unlink(newvindexname.c_str());
+  int flags = PageFile::WRITE_BACK | (readFlags & (PageFile::DIRECT|PageFile::LOGGED));
+  if ((rc = newrf.open(newtablename, 'w', flags | (rf.isCompressed() ? PageFile::COMPRESS : 0),
+                       rf.getPageSize(), rf.getFormat())) < 0) {
+    rf.close();
+    return rc;
+  }
+  if (index && (rc = newtree.open(newindexname, 'w', flags, indexPageSize)) < 0) {
+    newrf.close();
+    rf.close();
+    RecordFile::removeFile(newtablename);
+    return rc;
+  }
+  if (valueindex && (rc = newvtree.open(newvindexname, 'w', flags, vindexPageSize)) < 0) {
+    if (index) newtree.close();
+    newrf.close();
+    rf.close();
+    RecordFile::removeFile(newtablename);
+    ::unlink(newindexname.c_str());
+    return rc;
+  }
+
+  // copy the live tuples in batches, as LOAD appends them. the Bloom
+  // filters are rebuilt without the keys and the values of the deleted
+  // tuples
+  RecordScan scan(rf);
+  vector<int> keys;
+  vector<string> values;
+  vector<RecordId> rids;
+  vector<unsigned long long> keyHashes;
+  vector<unsigned long long> valueHashes;
+  RecordId rid;
+  int key;
+  ValueView value;
+  long long tuples = 0;
+  bool endoftable = false;
+  while (rc == 0 && !endoftable) {
+    keys.clear();
+    values.clear();
+    while ((int)keys.size() < LOAD_BATCH_SIZE) {
+      if ((rc = scan.next(rid, key, value)) < 0) {
+        endoftable = true;
+        if (rc == RC_END_OF_SCAN) rc = 0;
+        break;
+      }
+      keys.push_back(key);
+      values.push_back(value.str());
+      addHashes(key, values.back(), keyHashes, valueHashes);
+    }
+    if (rc == 0) rc = newrf.appendBatch(keys, values, rids);
+    for (unsigned i = 0; rc == 0 && index && i < rids.size(); i++) {
+      rc = newtree.insert(keys[i], rids[i]);
+    }
+    for (unsigned i = 0; rc == 0 && valueindex && i < rids.size(); i++) {
+      rc = newvtree.insert(values[i], rids[i]);
+    }
+    tuples += keys.size();
+  }
+
+  if (rc == 0 && (readFlags & PageFile::LOGGED)) {
+    if (index) rc = newtree.commit();
+    if (rc == 0 && valueindex) rc = newvtree.commit();
+    if (rc == 0) rc = newrf.commit();
+  }
+
+  int oldpages = rf.endRid().pid + (rf.endRid().sid > 0);
+  int newpages = newrf.endRid().pid + (newrf.endRid().sid > 0);
+  if (index) newtree.close();
+  if (valueindex) newvtree.close();
+  newrf.close();
+  rf.close();
+  if (rc < 0) {
+    fprintf(stderr, "Error: while compacting table %s\n", table.c_str());
+    RecordFile::removeFile(newtablename);
+    ::unlink(newindexname.c_str());
+    ::unlink(newvindexname.c_str());
+    return rc;
+  }
+
+  // the log must not refer to the new files by their temporary names
+  // once they are renamed
+  if ((readFlags & PageFile::LOGGED) && WriteAheadLog::global().isOpen() &&
+      (rc = WriteAheadLog::global().checkpoint()) < 0) {
+    return rc;
+  }
+
+  // swap the new files in. each rename is atomic
+  if ((rc = RecordFile::renameFile(newtablename, tablename)) < 0) return rc;
+  if (index && ::rename(newindexname.c_str(), indexname.c_str()) < 0) return RC_FILE_WRITE_FAILED;
+  if (valueindex && ::rename(newvindexname.c_str(), vindexname.c_str()) < 0) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  if ((rc = writeFilters(table, keyHashes, valueHashes)) < 0) return rc;
+
+  fprintf(stdout, "%s: %lld tuples compacted from %d to %d pages\n",
+          tablename.c_str(), tuples, oldpages, newpages);
+  return 0;
+}
+
+RC SqlEngine::createIndex(const string& table, int attr)
+{
+  RC rc;
+  RecordFile rf;
+  BTreeIndex<int> tree;
+  ValueIndex vtree;
+  string indexname = table + (attr == 1 ? ".idx" : VALUE_INDEX_SUFFIX);
+  string newindexname = indexname + COMPACT_SUFFIX;
+
+  if (attr != 1 && attr != 2) {
+    fprintf(stderr, "Error: an index can be created on the key or the value only\n");
+    return RC_INVALID_ATTRIBUTE;
+  }
+
+  if ((rc = rf.open(table + ".tbl", 'r', readFlags)) < 0) {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    return rc;
+  }
+
+  // the new index keeps the page size of the index it replaces, or
+  // takes that of the table if there is none
+  int indexPageSize = rf.getPageSize();
+  if (::access(indexname.c_str(), F_OK) == 0) {
+    if (attr == 1 && tree.open(indexname, 'r', readFlags) == 0) {
+      indexPageSize = tree.pf.getPageSize();
+      tree.close();
+    } else if (attr == 2 && vtree.open(indexname, 'r', readFlags) == 0) {
+      indexPageSize = vtree.getPageSize();
+      vtree.close();
+    }
+  }
+
+  // the index is built in a new file, which replaces the old index once
+  // it is complete, as COMPACT does it
+  ::unlink(newindexname.c_str());
+  int flags = PageFile::WRITE_BACK | (readFlags & (PageFile::DIRECT|PageFile::LOGGED));
+  if ((rc = (attr == 1) ? tree.open(newindexname, 'w', flags, indexPageSize)
+                        : vtree.open(newindexname, 'w', flags, indexPageSize)) < 0) {
+    fprintf(stderr, "Error: while indexing table %s\n", table.c_str());
+    ::unlink(newindexname.c_str());
+    rf.close();
+    return rc;
+  }
+
+  RecordScan scan(rf);
+  RecordId rid;
+  int key;
+  ValueView value;
+  long long entries = 0;
+  while ((rc = (attr == 1) ? scan.nextKey(rid, key) : scan.next(rid, key, value)) == 0) {
+    rc = (attr == 1) ? tree.insert(key, rid) : vtree.insert(value.str(), rid);
+    if (rc < 0) break;
+    entries++;
+  }
+  if (rc == RC_END_OF_SCAN) rc = 0;
+
+  if (rc == 0 && (readFlags & PageFile::LOGGED)) {
+    rc = (attr == 1) ? tree.commit() : vtree.commit();
+  }
+  if (attr == 1) {
+    tree.close();
+  } else {
+    vtree.close();
+  }
+  rf.close();
+  if (rc < 0) {
+    fprintf(stderr, "Error: while indexing table %s\n", table.c_str());
+    ::unlink(newindexname.c_str());
+    return rc;
+  }
+
+  // the log must not refer to the new file by its temporary name
+  if ((readFlags & PageFile::LOGGED) && WriteAheadLog::global().isOpen() &&
+      (rc = WriteAheadLog::global().checkpoint()) < 0) {
+    return rc;
+  }
+  if (::rename(newindexname.c_str(), indexname.c_str()) < 0) return RC_FILE_WRITE_FAILED;
+
+  fprintf(stdout, "%s: %lld entries indexed\n", indexname.c_str(), entries);
+  return 0;
+}
+
+static bool keyRange(const vector<SelCond>& cond, int& low, int& high)
+{
+  long long l = INT_MIN, h = INT_MAX;
+
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 1) continue;
+    long long v = atoi(cond[i].value);
+    switch (cond[i].comp) {
+    case SelCond::EQ: l = std::max(l, v); h = std::min(h, v); break;
+    case SelCond::GT: l = std::max(l, v + 1); break;
+    case SelCond::GE: l = std::max(l, v); break;
+    case SelCond::LT: h = std::min(h, v - 1); break;
+    case SelCond::LE: h = std::min(h, v); break;
+    case SelCond::NE: break;
+    }
+  }
+  if (l > h) return false;
+
+  low = (int)l;
+  high = (int)h;
+  return true;
+}
+
+static bool valueRange(const vector<SelCond>& cond, string& low, string& high)
+{
+  bool bounded = false;
+
+  // no value is greater than MAX_VALUE_LENGTH bytes of 0xff
+  low.clear();
+  high.assign(RecordFile::MAX_VALUE_LENGTH, (char)0xff);
+
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 2) continue;
+    string v = cond[i].value;
+    switch (cond[i].comp) {
+    case SelCond::EQ: low = std::max(low, v); high = std::min(high, v); break;
+    case SelCond::GT: case SelCond::GE: low = std::max(low, v); break;
+    case SelCond::LT: case SelCond::LE: high = std::min(high, v); break;
+    case SelCond::NE: continue;
+    }
+    bounded = true;
+  }
+  return bounded;
+}
+
+static bool satisfies(int key, const ValueView& value, const vector<SelCond>& cond)
+{
+  for (unsigned i = 0; i < cond.size(); i++) {
+    // compute the difference between the tuple value and the condition value
+    int diff = (cond[i].attr == 1) ? key - atoi(cond[i].value) : value.compare(cond[i].value);
+
+    switch (cond[i].comp) {
+    case SelCond::EQ: if (diff != 0) return false; break;
+    case SelCond::NE: if (diff == 0) return false; break;
+    case SelCond::GT: if (diff <= 0) return false; break;
+    case SelCond::LT: if (diff >= 0) return false; break;
+    case SelCond::GE: if (diff < 0) return false; break;
+    case SelCond::LE: if (diff > 0) return false; break;
+    }
+  }
+  return true;
+}
+
+static RC findTuples(const RecordFile& rf, BTreeIndex<int>& tree, ValueIndex& vtree,
+                     const vector<SelCond>& cond, vector<int>& keys, vector<RecordId>& rids)
+{
+  RC rc;
+  int key;
+  RecordId rid;
+  ValueView value;
+  PageGuard guard;
+
+  // the range of keys the conditions allow
+  int low, high;
+  if (!keyRange(cond, low, high)) return 0;
+
+  // look the range up in the index
+  if ((low > INT_MIN || high < INT_MAX) && tree.treeHeight > 0) {
+    IndexCursor cursor;
+    tree.locate(low, cursor);
+    while (tree.readForward(cursor, key, rid) == 0) {
+      if (key > high) break;
+      if (key < low) continue;
+      if ((rc = rf.read(rid, key, value, guard)) < 0) return rc;
+      if (!satisfies(key, value, cond)) continue;
+      keys.push_back(key);
+      rids.push_back(rid);
+    }
+    return 0;
+  }
+
+  // or the range of values in the value index
+  string vlow, vhigh;
+  if (vtree.getTreeHeight() > 0 && valueRange(cond, vlow, vhigh)) {
+    IndexCursor cursor;
+    string v;
+    vtree.locate(vlow, cursor);
+    while (vtree.readForward(cursor, v, rid) == 0) {
+      if (v.compare(vhigh) > 0) break;
+      if ((rc = rf.read(rid, key, value, guard)) < 0) return rc;
+      if (!satisfies(key, value, cond)) continue;
+      keys.push_back(key);
+      rids.push_back(rid);
+    }
+    return 0;
+  }
+
+  // otherwise scan the pages the zone map does not rule out
+  RecordScan scan(rf);
+  scan.setKeyRange(low, high);
+  while ((rc = scan.next(rid, key, value)) == 0) {
+    if (!satisfies(key, value, cond)) continue;
+    keys.push_back(key);
+    rids.push_back(rid);
+  }
+  return (rc == RC_END_OF_SCAN) ? 0 : rc;
+}
+
+static RC openForWrite(const string& table, int readFlags, RecordFile& rf, BTreeIndex<int>& tree,
+                       ValueIndex& vtree)
+{
+  RC rc;
+
+  // 'w' mode would create a missing table
+  if (::access((table + ".tbl").c_str(), F_OK) < 0) {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    return RC_FILE_OPEN_FAILED;
+  }
+
+  // the changed pages are buffered and logged as LOAD does it
+  int flags = PageFile::WRITE_BACK | (readFlags & (PageFile::DIRECT|PageFile::LOGGED));
+  if ((rc = rf.open(table + ".tbl", 'w', flags)) < 0) return rc;
+  tree.open(table + ".idx", 'w', flags);
+
+  // the index on the values is opened only if the table has one
+  string vindexname = table + VALUE_INDEX_SUFFIX;
+  if (::access(vindexname.c_str(), F_OK) == 0 && (rc = vtree.open(vindexname, 'w', flags)) < 0) {
+    tree.close();
+    rf.close();
+    return rc;
+  }
+  return 0;
+}
+
+static RC closeForWrite(int readFlags, RecordFile& rf, BTreeIndex<int>& tree, ValueIndex& vtree)
+{
+  RC rc = 0;
+
+  if (readFlags & PageFile::LOGGED) {
+    if (tree.treeHeight > 0) rc = tree.commit();
+    if (rc == 0 && vtree.getTreeHeight() > 0) rc = vtree.commit();
+    if (rc == 0) rc = rf.commit();
+  }
+  tree.close();
+  vtree.close();
+  rf.close();
+  return rc;
+}
+
+static const TableFilters* readFilters(const string& table)
+{
+  string filename = table + FILTER_SUFFIX;
+  struct stat st;
+
+  // the cached filters are good as long as the file has not been replaced
+  if (::stat(filename.c_str(), &st) < 0) {
+    filterCache.erase(table);
+    return NULL;
+  }
+  std::map<string, TableFilters>::iterator it = filterCache.find(table);
+  if (it != filterCache.end() && it->second.file.st_dev == st.st_dev &&
+      it->second.file.st_ino == st.st_ino && it->second.file.st_size == st.st_size &&
+      it->second.file.st_mtime == st.st_mtime) {
+    return &it->second;
+  }
+
+  TableFilters filters;
+  FILE* fp = fopen(filename.c_str(), "rb");
+  if (fp == NULL) return NULL;
+  RC rc = filters.keys.read(fp);
+  if (rc == 0) rc = filters.values.read(fp);
+  fclose(fp);
+
+  // damaged filters are as good as none
+  if (rc < 0) {
+    filterCache.erase(table);
+    return NULL;
+  }
+  filters.file = st;
+  return &(filterCache[table] = filters);
+}
+
+static RC writeFilters(const string& table, const vector<unsigned long long>& keyHashes,
+                       const vector<unsigned long long>& valueHashes)
+{
+  TableFilters filters;
+
+  filters.keys.reset(keyHashes.size());
+  for (unsigned i = 0; i < keyHashes.size(); i++) filters.keys.add(keyHashes[i]);
+  filters.values.reset(valueHashes.size());
+  for (unsigned i = 0; i < valueHashes.size(); i++) filters.values.add(valueHashes[i]);
+  return writeFilters(table, filters);
+}
+
+static RC writeFilters(const string& table, TableFilters& filters)
+{
+  string filename = table + FILTER_SUFFIX;
+  string tmpname = filename + ".tmp";
+
+  // the filters are written to a new file and fsynced before the file
+  // replaces the old one, so a crash leaves the old filters or the new
+  FILE* fp = fopen(tmpname.c_str(), "wb");
+  if (fp == NULL) return RC_FILE_OPEN_FAILED;
+  RC rc = filters.keys.write(fp);
+  if (rc == 0) rc = filters.values.write(fp);
+  if (rc == 0 && (fflush(fp) != 0 || ::fsync(fileno(fp)) < 0)) rc = RC_FILE_WRITE_FAILED;
+  if (fclose(fp) != 0 && rc == 0) rc = RC_FILE_WRITE_FAILED;
+  if (rc == 0 && ::rename(tmpname.c_str(), filename.c_str()) < 0) rc = RC_FILE_WRITE_FAILED;
+  if (rc < 0) {
+    ::unlink(tmpname.c_str());
+    return rc;
+  }
+
+  // the filters just written are cached as read from the new file
+  if (::stat(filename.c_str(), &filters.file) == 0) {
+    filterCache[table] = filters;
+  } else {
+    filterCache.erase(table);
+  }
+  return 0;
+}
+
+static void dropFilters(const string& table)
+{
+  ::unlink((table + FILTER_SUFFIX).c_str());
+  filterCache.erase(table);
+}
+
+static string storedValue(const string& value)
+{
+  // a value is stored up to its first NUL, and truncated to fit a slot
+  return string(value.c_str(), strnlen(value.c_str(), RecordFile::MAX_VALUE_LENGTH - 1));
+}
+
+static void addHashes(int key, const string& value, vector<unsigned long long>& keyHashes,
+                      vector<unsigned long long>& valueHashes)
+{
+  string v = storedValue(value);
+  keyHashes.push_back(BloomFilter::hash(&key, sizeof(key)));
+  valueHashes.push_back(BloomFilter::hash(v.data(), v.size()));
+}
+
+static bool mayMatch(const string& table, const vector<SelCond>& cond)
+{
+  const TableFilters* filters = NULL;
+
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].comp != SelCond::EQ) continue;
+    if (filters == NULL && (filters = readFilters(table)) == NULL) return true;
+
+    if (cond[i].attr == 1) {
+      int key = atoi(cond[i].value);
+      if (!filters->keys.mayContain(BloomFilter::hash(&key, sizeof(key)))) return false;
+    } else {
+      if (!filters->values.mayContain(BloomFilter::hash(cond[i].value, strlen(cond[i].value)))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+RC SqlEngine::setPageSize(int size)
+{
+  if (!PageFile::isValidPageSize(size)) return RC_INVALID_PAGE_SIZE;
+  pageSize = size;
+  return 0;
+}
+
+void SqlEngine::stats()
+{
+  vector<PageFile::FileStats> files;
+  PageFile::getAllIOStats(files);
+  for (unsigned i = 0; i < files.size(); i++) {
+    files[i].stats.print(stdout, files[i].name.c_str());
+    int extents = PageFile::countDiskExtents(files[i].name);
+    if (extents >= 0) fprintf(stdout, "  stored in %d extents on disk\n", extents);
+  }
+
+  IOStats::Snapshot total = PageFile::getTotalIOStats();
+  total.print(stdout, "total");
+  total.printLatency(stdout);
+
+  BufferPool& pool = BufferPool::global();
+  static const char* memory[] = { "regular pages", "transparent huge pages", "huge pages" };
+  fprintf(stdout, "buffer pool: %lld hits, %lld misses, %lu of %lu bytes used, %s\n",
+          pool.getHitCount(), pool.getMissCount(), (unsigned long)pool.getUsed(),
+          (unsigned long)pool.getCapacity(), memory[pool.getMemory()]);
+
+  WriteAheadLog& wal = WriteAheadLog::global();
+  if (wal.isOpen()) wal.printStats(stdout);
+}
+
+void SqlEngine::printIOSince(FILE* out, const vector<PageFile::FileStats>& before)
+{
+  vector<PageFile::FileStats> after;
+  PageFile::getAllIOStats(after);
+
+  // a file is matched by its inode, as a file renamed over another has
+  // the name of the other. a file opened for the first time has no
+  // counters in before
+  for (unsigned i = 0; i < after.size(); i++) {
+    IOStats::Snapshot delta = after[i].stats;
+    for (unsigned j = 0; j < before.size(); j++) {
+      if (before[j].dev != after[i].dev || before[j].ino != after[i].ino) continue;
+      delta = after[i].stats - before[j].stats;
+      break;
+    }
+    if (delta.empty()) continue;
+    delta.print(out, ("  -- " + after[i].name).c_str());
+  }
+}
+
 RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
 {
     const char *s;
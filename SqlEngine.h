@@ -59,6 +59,53 @@ class SqlEngine {
    */
   static RC load(const std::string& table, const std::string& loadfile, bool index);
 
+  /**
+   * executes an UPDATE statement.
+   * all conditions in conds must be ANDed together.
+   * the matching tuples are rewritten in place, and the indexes of the
+   * table follow the tuples whose key or value changed or that moved.
+   * @param table[IN] the table name in the UPDATE clause
+   * @param attr[IN] attribute in the SET clause (1: key, 2: value)
+   * @param value[IN] the new value of the attribute
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @return error code. 0 if no error
+   */
+  static RC update(const std::string& table, int attr, const char* value,
+                   const std::vector<SelCond>& conds);
+
+  /**
+   * executes a DELETE statement.
+   * all conditions in conds must be ANDed together.
+   * the matching tuples leave tombstones in the table until it is
+   * compacted, and their entries are removed from the indexes.
+   * @param table[IN] the table name in the FROM clause
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @return error code. 0 if no error
+   */
+  static RC remove(const std::string& table, const std::vector<SelCond>& conds);
+
+  /**
+   * executes a COMPACT statement.
+   * the live tuples of the table are copied to new table and index
+   * files, which then replace the old ones. queries that have the old
+   * files open are not blocked, and go on reading the old files.
+   * @param table[IN] the table name in the COMPACT statement
+   * @return error code. 0 if no error
+   */
+  static RC compact(const std::string& table);
+
+  /**
+   * executes a CREATE INDEX statement.
+   * the index is built from the tuples of the table, and replaces the
+   * old index of the attribute, if any. once a table has an index on
+   * its values, LOAD, UPDATE, DELETE and COMPACT keep it up to date,
+   * and SELECT uses it for the conditions on the value.
+   * @param table[IN] the table name in the CREATE INDEX statement
+   * @param attr[IN] the attribute to index (1: key, 2: value)
+   * @return error code. 0 if no error
+   */
+  static RC createIndex(const std::string& table, int attr);
+
   /**
    * parse a line from the load file into the (key, value) pair.
    * @param line[IN] a line from a load file
@@ -67,6 +114,49 @@ class SqlEngine {
    * @return error code. 0 if no error
    */
   static RC parseLoadLine(const std::string& line, int& key, std::string& value);
+
+  /**
+   * print the I/O counters of every table and index file used so far,
+   * and the syscall latency histograms of all files together.
+   */
+  static void stats();
+
+  /**
+   * print the I/O of every file that did I/O since its counters were
+   * saved in before (e.g., by a query).
+   * @param out[IN] the stream to print to
+   * @param before[IN] the counters saved by PageFile::getAllIOStats()
+   */
+  static void printIOSince(FILE* out, const std::vector<PageFile::FileStats>& before);
+
+  /**
+   * set the PageFile option flags used to open the table and index
+   * files for SELECT (e.g., PageFile::MMAP). PageFile::DIRECT is
+   * used by LOAD as well, and PageFile::COMPRESS and PageFile::LOGGED
+   * only by LOAD, for the files it writes.
+   * @param flags[IN] PageFile option flags ORed together
+   */
+  static void setReadFlags(int flags) { readFlags = flags; }
+
+  /**
+   * set the page size of the table and index files created by LOAD.
+   * @param size[IN] the page size in bytes (a power of two between
+   *                 PageFile::PAGE_SIZE and PageFile::MAX_PAGE_SIZE)
+   * @return error code. 0 if no error
+   */
+  static RC setPageSize(int size);
+
+  /**
+   * set the record format of the table files created by LOAD.
+   * @param format[IN] RecordFile::FIXED_SLOTS, RecordFile::SLOTTED or
+   *                   RecordFile::COLUMNAR
+   */
+  static void setRecordFormat(RecordFile::Format format) { recordFormat = format; }
+
+ private:
+  static int readFlags;  // PageFile option flags for SELECT
+  static int pageSize;   // page size of the files created by LOAD
+  static RecordFile::Format recordFormat; // format of the tables created by LOAD
 };
 
 #endif /* SQLENGINE_H */
@@ -17,15 +17,18 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
 {
   struct tms tmsbuf;
   clock_t btime, etime;
-  int     bpagecnt, epagecnt;
+  long long bpagecnt, epagecnt;
+  std::vector<PageFile::FileStats> bstats;
 
   btime = times(&tmsbuf);
   bpagecnt = PageFile::getPageReadCount();
+  PageFile::getAllIOStats(bstats);
   SqlEngine::select(attr, table, conds);
   etime = times(&tmsbuf);
   epagecnt = PageFile::getPageReadCount();
 
-  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %lld pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+  SqlEngine::printIOSince(stderr, bstats);
 }
 
 %}
@@ -37,7 +40,8 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
   std::vector<SelCond>* conds;
 }
 
-%token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT AND OR 
+%token SELECT FROM WHERE LOAD WITH INDEX QUIT STATS COUNT AND OR 
+%token UPDATE SET DELETE COMPACT CREATE ON
 %token COMMA STAR LF
 %token <string> INTEGER STRING ID
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
@@ -56,6 +60,11 @@ commands:
 command:
         load_command { fprintf(stdout, "Bruinbase> "); }
 	| select_command { fprintf(stdout, "Bruinbase> "); }
+	| stats_command { fprintf(stdout, "Bruinbase> "); }
+	| update_command { fprintf(stdout, "Bruinbase> "); }
+	| delete_command { fprintf(stdout, "Bruinbase> "); }
+	| compact_command { fprintf(stdout, "Bruinbase> "); }
+	| create_command { fprintf(stdout, "Bruinbase> "); }
 	| quit_command
 	| error LF { fprintf(stdout, "Bruinbase> "); }
 	| LF { fprintf(stdout, "Bruinbase> "); }
@@ -78,6 +87,61 @@ load_command:
 	}
 	;
 
+stats_command:
+	STATS LF {
+	  SqlEngine::stats();
+	}
+	;
+
+update_command:
+	UPDATE table SET attribute EQUAL value LF {
+	        std::vector<SelCond> conds;
+		// a wrong attribute name was reported by the attribute rule
+		if ($4 != 0) SqlEngine::update($2, $4, $6, conds);
+		free($2);
+		free($6);
+	}
+	| UPDATE table SET attribute EQUAL value WHERE conditions LF {
+		if ($4 != 0) SqlEngine::update($2, $4, $6, *$8);
+		free($2);
+		free($6);
+	  	for (unsigned i = 0; i < $8->size(); i++) {
+		    free((*$8)[i].value);
+		}
+	  	delete $8;
+	}
+	;
+
+delete_command:
+	DELETE FROM table LF {
+	        std::vector<SelCond> conds;
+		SqlEngine::remove($3, conds);
+		free($3);
+	}
+	| DELETE FROM table WHERE conditions LF {
+		SqlEngine::remove($3, *$5);
+		free($3);
+	  	for (unsigned i = 0; i < $5->size(); i++) {
+		    free((*$5)[i].value);
+		}
+	  	delete $5;
+	}
+	;
+
+compact_command:
+	COMPACT table LF {
+		SqlEngine::compact($2);
+		free($2);
+	}
+	;
+
+create_command:
+	CREATE INDEX ON table attribute LF {
+		if ($5 != 0) SqlEngine::createIndex($4, $5);
+		free($4);
+	}
+	;
+
 select_command:
 	SELECT attributes FROM table LF {
    	        std::vector<SelCond> conds;
@@ -128,7 +192,7 @@ attribute:
 	ID { 
 		if (strcasecmp($1, "key") == 0) $$=1;
 		else if (strcasecmp($1, "value") == 0) $$=2;
-		else sqlerror("wrong attribute name. neither key or value");
+		else { sqlerror("wrong attribute name. neither key or value"); $$=0; }
 		free($1);
 	}
 
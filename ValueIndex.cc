@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstring>
+#include "ValueIndex.h"
+
+using namespace std;
+
+//
+// a node is [# entries][link][entries]. in a leaf, an entry is
+// [# bytes shared with the previous value][# bytes that follow][the
+// bytes that follow][RecordId], and in a non-leaf node it is
+// [# bytes][the bytes][RecordId][child PageId]. the lengths take one
+// byte each, which is enough for RecordFile::MAX_VALUE_LENGTH
+//
+static const int NODE_HEADER = sizeof(int) + sizeof(PageId);
+
+// smaller than the RecordId of any tuple
+static const RecordId MIN_RID = { -1, -1 };
+
+static int compare(const string& v1, const RecordId& r1, const string& v2, const RecordId& r2)
+{
+  int diff = v1.compare(v2);
+  if (diff != 0) return diff;
+  if (r1 < r2) return -1;
+  return r1 > r2;
+}
+
+static int sharedPrefix(const string& v1, const string& v2)
+{
+  int n = 0;
+  int max = (int)(v1.size() < v2.size() ? v1.size() : v2.size());
+  while (n < max && n < 255 && v1[n] == v2[n]) n++;
+  return n;
+}
+
+// # bytes the entry takes in a node. in a leaf, prev is the entry
+// before it, or NULL for the first entry
+static int entrySize(const ValueIndex::Entry& entry, const ValueIndex::Entry* prev, bool leaf)
+{
+  if (!leaf) return 1 + (int)entry.value.size() + sizeof(RecordId) + sizeof(PageId);
+
+  int shared = prev ? sharedPrefix(prev->value, entry.value) : 0;
+  return 2 + (int)entry.value.size() - shared + sizeof(RecordId);
+}
+
+// the first entry of [0, n) that is not smaller than (value, rid)
+static int lowerBound(const vector<ValueIndex::Entry>& entries, const string& value, const RecordId& rid)
+{
+  int low = 0, high = (int)entries.size();
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (compare(entries[mid].value, entries[mid].rid, value, rid) < 0) low = mid + 1;
+    else high = mid;
+  }
+  return low;
+}
+
+// the child of a non-leaf node to follow for (value, rid). the entries
+// equal to a separator are in the subtree behind it
+static PageId childFor(const vector<ValueIndex::Entry>& entries, PageId first,
+                       const string& value, const RecordId& rid)
+{
+  int low = 0, high = (int)entries.size();
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (compare(entries[mid].value, entries[mid].rid, value, rid) <= 0) low = mid + 1;
+    else high = mid;
+  }
+  return low == 0 ? first : entries[low - 1].pid;
+}
+
+ValueIndex::ValueIndex()
+{
+  rootPid = -1;
+  treeHeight = 0;
+  leafPid = -1;
+  leafNext = 0;
+}
+
+RC ValueIndex::open(const string& indexname, char mode, int flags, int pageSize)
+{
+  RC  rc;
+  int header[2];
+
+  if ((rc = pf.open(indexname, mode, flags, pageSize)) < 0) return rc;
+
+  leafPid = -1;
+  leafEntries.clear();
+
+  if (pf.endPid() == 0) {
+    rootPid = -1;
+    treeHeight = 0;
+    if (mode == 'w' && (rc = writeHeader()) < 0) {
+      pf.close();
+      return rc;
+    }
+    return 0;
+  }
+
+  // the root pid and the tree height are at the start of page 0
+  PageGuard guard;
+  if ((rc = pf.pin(0, guard)) < 0) {
+    pf.close();
+    return rc;
+  }
+  memcpy(header, guard.data(), sizeof(header));
+  rootPid = header[0];
+  treeHeight = header[1];
+
+  return 0;
+}
+
+RC ValueIndex::close()
+{
+  leafPid = -1;
+  leafEntries.clear();
+  return pf.close();
+}
+
+RC ValueIndex::commit()
+{
+  return pf.commit();
+}
+
+RC ValueIndex::writeHeader()
+{
+  vector<char> page(pf.getPageSize(), 0);
+  int header[2] = { rootPid, treeHeight };
+
+  memcpy(&page[0], header, sizeof(header));
+  return pf.write(0, &page[0]);
+}
+
+RC ValueIndex::readNode(PageId pid, bool leaf, vector<Entry>& entries, PageId& link)
+{
+  RC     rc;
+  int    count;
+  string prev;
+
+  PageGuard guard;
+  if ((rc = pf.pin(pid, guard)) < 0) return rc;
+  const char* page = guard.data();
+  const char* end = page + pf.getPageSize();
+
+  memcpy(&count, page, sizeof(int));
+  memcpy(&link, page + sizeof(int), sizeof(PageId));
+  const char* p = page + NODE_HEADER;
+
+  entries.resize(count < 0 ? 0 : count);
+  for (int i = 0; i < count; i++) {
+    Entry& entry = entries[i];
+    int shared = 0;
+    if (leaf) {
+      if (p + 2 > end) return RC_INVALID_FILE_FORMAT;
+      shared = (unsigned char)*p++;
+      if (shared > (int)prev.size()) return RC_INVALID_FILE_FORMAT;
+    }
+    int length = (unsigned char)*p++;
+    if (p + length + sizeof(RecordId) + (leaf ? 0 : sizeof(PageId)) > end) {
+      return RC_INVALID_FILE_FORMAT;
+    }
+
+    entry.value.assign(prev, 0, shared);
+    entry.value.append(p, length);
+    p += length;
+    memcpy(&entry.rid, p, sizeof(RecordId));
+    p += sizeof(RecordId);
+    if (leaf) {
+      entry.pid = -1;
+      prev = entry.value;
+    } else {
+      memcpy(&entry.pid, p, sizeof(PageId));
+      p += sizeof(PageId);
+    }
+  }
+
+  return 0;
+}
+
+RC ValueIndex::writeNode(PageId pid, bool leaf, const vector<Entry>& entries,
+                         int begin, int end, PageId link)
+{
+  int size = pf.getPageSize();
+  vector<char> page(size, 0);
+  int count = end - begin;
+
+  memcpy(&page[0], &count, sizeof(int));
+  memcpy(&page[sizeof(int)], &link, sizeof(PageId));
+  int pos = NODE_HEADER;
+
+  for (int i = begin; i < end; i++) {
+    const Entry& entry = entries[i];
+    const Entry* prev = (leaf && i > begin) ? &entries[i - 1] : NULL;
+    if (pos + entrySize(entry, prev, leaf) > size) return RC_NODE_FULL;
+
+    int shared = prev ? sharedPrefix(prev->value, entry.value) : 0;
+    if (leaf) page[pos++] = (char)shared;
+    page[pos++] = (char)(entry.value.size() - shared);
+    memcpy(&page[pos], entry.value.data() + shared, entry.value.size() - shared);
+    pos += entry.value.size() - shared;
+    memcpy(&page[pos], &entry.rid, sizeof(RecordId));
+    pos += sizeof(RecordId);
+    if (!leaf) {
+      memcpy(&page[pos], &entry.pid, sizeof(PageId));
+      pos += sizeof(PageId);
+    }
+  }
+
+  // the cached leaf is read again when it changes
+  if (pid == leafPid) leafPid = -1;
+
+  return pf.write(pid, &page[0]);
+}
+
+RC ValueIndex::insert(const string& value, const RecordId& rid)
+{
+  RC    rc;
+  Entry entry, split;
+
+  entry.value = value.substr(0, RecordFile::MAX_VALUE_LENGTH);
+  entry.rid = rid;
+  entry.pid = -1;
+
+  if (treeHeight == 0) {
+    vector<Entry> entries(1, entry);
+    rootPid = pf.endPid();
+    if ((rc = writeNode(rootPid, true, entries, 0, 1, 0)) < 0) return rc;
+    treeHeight = 1;
+    return writeHeader();
+  }
+
+  if ((rc = insertRec(rootPid, 1, entry, split)) < 0) return rc;
+  if (split.pid < 0) return 0;
+
+  // the root split. the new root points to the old root and its sibling
+  vector<Entry> entries(1, split);
+  PageId pid = pf.endPid();
+  if ((rc = writeNode(pid, false, entries, 0, 1, rootPid)) < 0) return rc;
+  rootPid = pid;
+  treeHeight++;
+  return writeHeader();
+}
+
+RC ValueIndex::insertRec(PageId pid, int height, const Entry& entry, Entry& split)
+{
+  RC            rc;
+  bool          leaf = (height == treeHeight);
+  vector<Entry> entries;
+  PageId        link;
+
+  split.pid = -1;
+  if ((rc = readNode(pid, leaf, entries, link)) < 0) return rc;
+
+  if (leaf) {
+    entries.insert(entries.begin() + lowerBound(entries, entry.value, entry.rid), entry);
+  } else {
+    Entry child;
+    PageId childPid = childFor(entries, link, entry.value, entry.rid);
+    if ((rc = insertRec(childPid, height + 1, entry, child)) < 0) return rc;
+    if (child.pid < 0) return 0;
+    entries.insert(entries.begin() + lowerBound(entries, child.value, child.rid), child);
+  }
+
+  rc = writeNode(pid, leaf, entries, 0, entries.size(), link);
+  if (rc != RC_NODE_FULL) return rc;
+
+  // split the node where the first half of its bytes ends. a value
+  // takes at most a few hundred bytes, so both halves fit in a page
+  int n = entries.size();
+  int total = 0;
+  for (int i = 0; i < n; i++) {
+    total += entrySize(entries[i], (leaf && i > 0) ? &entries[i - 1] : NULL, leaf);
+  }
+  int k = 0;
+  for (int used = 0; k < n && used < total / 2; k++) {
+    used += entrySize(entries[k], (leaf && k > 0) ? &entries[k - 1] : NULL, leaf);
+  }
+  if (k < 1) k = 1;
+  if (k > n - (leaf ? 1 : 2)) k = n - (leaf ? 1 : 2);
+
+  PageId sibling = pf.endPid();
+  if (leaf) {
+    // the sibling takes [k, n) and comes after the node in the leaf chain
+    if ((rc = writeNode(sibling, true, entries, k, n, link)) < 0) return rc;
+    if ((rc = writeNode(pid, true, entries, 0, k, sibling)) < 0) return rc;
+    split = entries[k];
+  } else {
+    // entry k moves up, and its child becomes the first child of the sibling
+    if ((rc = writeNode(sibling, false, entries, k + 1, n, entries[k].pid)) < 0) return rc;
+    if ((rc = writeNode(pid, false, entries, 0, k, link)) < 0) return rc;
+    split = entries[k];
+  }
+  split.pid = sibling;
+
+  return 0;
+}
+
+RC ValueIndex::remove(const string& value, const RecordId& rid)
+{
+  RC            rc;
+  vector<Entry> entries;
+  PageId        pid = rootPid;
+  PageId        link;
+  string        v = value.substr(0, RecordFile::MAX_VALUE_LENGTH);
+
+  if (treeHeight == 0) return RC_NO_SUCH_RECORD;
+
+  for (int height = 1; height < treeHeight; height++) {
+    if ((rc = readNode(pid, false, entries, link)) < 0) return rc;
+    pid = childFor(entries, link, v, rid);
+  }
+
+  if ((rc = readNode(pid, true, entries, link)) < 0) return rc;
+  int eid = lowerBound(entries, v, rid);
+  if (eid == (int)entries.size() || compare(entries[eid].value, entries[eid].rid, v, rid) != 0) {
+    return RC_NO_SUCH_RECORD;
+  }
+
+  // a leaf only gets smaller, so it still fits
+  entries.erase(entries.begin() + eid);
+  return writeNode(pid, true, entries, 0, entries.size(), link);
+}
+
+RC ValueIndex::locate(const string& value, IndexCursor& cursor)
+{
+  RC            rc;
+  vector<Entry> entries;
+  PageId        pid = rootPid;
+  PageId        link;
+
+  if (treeHeight == 0) {
+    cursor.pid = 0;
+    cursor.eid = 1;
+    return RC_NO_SUCH_RECORD;
+  }
+
+  for (int height = 1; height < treeHeight; height++) {
+    if ((rc = readNode(pid, false, entries, link)) < 0) return rc;
+    pid = childFor(entries, link, value, MIN_RID);
+  }
+
+  if ((rc = readLeaf(pid)) < 0) return rc;
+  int eid = lowerBound(leafEntries, value, MIN_RID);
+  cursor.pid = pid;
+  cursor.eid = eid + 1;
+
+  if (eid < (int)leafEntries.size()) {
+    return leafEntries[eid].value == value ? 0 : RC_NO_SUCH_RECORD;
+  }
+
+  // the entry may start the next leaf
+  IndexCursor next = cursor;
+  string v;
+  RecordId r;
+  if (readForward(next, v, r) < 0 || v != value) return RC_NO_SUCH_RECORD;
+  return 0;
+}
+
+RC ValueIndex::readLeaf(PageId pid)
+{
+  RC rc;
+
+  if (pid == leafPid) return 0;
+  leafPid = -1;
+  if ((rc = readNode(pid, true, leafEntries, leafNext)) < 0) return rc;
+  leafPid = pid;
+  return 0;
+}
+
+RC ValueIndex::readForward(IndexCursor& cursor, string& value, RecordId& rid)
+{
+  RC rc;
+
+  // the cursor may be past the end of its leaf, and deletions may have
+  // left leaves empty. move on to the next leaf with an entry
+  for (;;) {
+    if (cursor.pid <= 0) return RC_END_OF_TREE;
+    if ((rc = readLeaf(cursor.pid)) < 0) return rc;
+    if (cursor.eid <= (int)leafEntries.size()) break;
+    cursor.pid = leafNext;
+    cursor.eid = 1;
+  }
+
+  const Entry& entry = leafEntries[cursor.eid - 1];
+  value = entry.value;
+  rid = entry.rid;
+  cursor.eid++;
+
+  return 0;
+}
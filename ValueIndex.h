@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef VALUEINDEX_H
+#define VALUEINDEX_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+
+/**
+ * A secondary B+tree index on the value column of a table.
+ * An entry is a (value, RecordId) pair. The entries are ordered by value
+ * and then by RecordId, so the entries of a value that many tuples share
+ * are told apart and can be removed one by one.
+ * A leaf stores its values front-coded: a value keeps only the bytes
+ * after the prefix it shares with the value before it, so the sorted
+ * values of a leaf, which often share long prefixes, take a fraction of
+ * their length. A non-leaf node stores whole values.
+ * A node is decoded into a list of entries, changed and encoded again,
+ * and a node whose encoding no longer fits in a page is split in two
+ * halves of about the same size. As in BTreeIndex, entries are removed
+ * lazily and nodes are never merged.
+ */
+class ValueIndex {
+ public:
+  ValueIndex();
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file is created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @param flags[IN] PageFile option flags (e.g., PageFile::WRITE_BACK)
+   * @param pageSize[IN] the page size of the index file if it is created
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode, int flags = 0,
+          int pageSize = PageFile::PAGE_SIZE);
+
+  /**
+   * Close the index file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * Make the changes so far durable (see PageFile::commit()).
+   * @return error code. 0 if no error
+   */
+  RC commit();
+
+  /**
+   * Insert a (value, RecordId) pair to the index.
+   * @param value[IN] the value of the record
+   * @param rid[IN] the RecordId of the record
+   * @return error code. 0 if no error
+   */
+  RC insert(const std::string& value, const RecordId& rid);
+
+  /**
+   * Remove a (value, RecordId) pair from the index.
+   * @param value[IN] the value of the entry to remove
+   * @param rid[IN] the RecordId of the entry to remove
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the index
+   *         has no such entry
+   */
+  RC remove(const std::string& value, const RecordId& rid);
+
+  /**
+   * Set the cursor to the first entry whose value is not smaller than
+   * the given value. Use readForward() to read the entries from there.
+   * @param value[IN] the value to find
+   * @param cursor[OUT] the cursor pointing to the entry
+   * @return 0 if an entry has the value. Otherwise RC_NO_SUCH_RECORD,
+   *         or an error code
+   */
+  RC locate(const std::string& value, IndexCursor& cursor);
+
+  /**
+   * Read the (value, RecordId) pair at the cursor, and move the cursor
+   * forward to the next entry.
+   * @param cursor[IN/OUT] the cursor pointing to a leaf entry
+   * @param value[OUT] the value of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @return error code. 0 if no error. RC_END_OF_TREE if the cursor is
+   *         past the last entry
+   */
+  RC readForward(IndexCursor& cursor, std::string& value, RecordId& rid);
+
+  /**
+   * @return the height of the tree. 0 if the index is empty
+   */
+  int getTreeHeight() const { return treeHeight; }
+
+  /**
+   * @return the page size of the index file
+   */
+  int getPageSize() const { return pf.getPageSize(); }
+
+  // an entry of a node. pid is the child behind the value in a
+  // non-leaf node, and not used in a leaf
+  struct Entry {
+    std::string value;
+    RecordId    rid;
+    PageId      pid;
+  };
+
+ private:
+  // insert the entry into the subtree at pid of the given height. when
+  // the node splits, split is set to the first entry of the new sibling
+  // with split.pid the sibling; otherwise split.pid is -1
+  RC insertRec(PageId pid, int height, const Entry& entry, Entry& split);
+
+  // decode a node. link is the next leaf of a leaf, or the first child
+  // of a non-leaf node
+  RC readNode(PageId pid, bool leaf, std::vector<Entry>& entries, PageId& link);
+
+  // encode and write the entries [begin, end) as a node.
+  // RC_NODE_FULL if they do not fit in a page
+  RC writeNode(PageId pid, bool leaf, const std::vector<Entry>& entries,
+               int begin, int end, PageId link);
+
+  // read the leaf at pid into the leaf cache of readForward()
+  RC readLeaf(PageId pid);
+
+  // write the root and the height of the tree to the first page
+  RC writeHeader();
+
+  PageFile pf;        // the PageFile of the index
+  PageId rootPid;     // the PageId of the root node
+  int treeHeight;     // the height of the tree
+
+  PageId leafPid;     // the leaf readForward() read last. -1 if none
+  PageId leafNext;    // the next leaf of that leaf
+  std::vector<Entry> leafEntries;  // the entries of that leaf
+};
+
+#endif // VALUEINDEX_H
@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "WriteAheadLog.h"
+#include "IOStats.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+
+//
+// a log record is a RecordHeader followed by size bytes: the name of a
+// data file (FILE_RECORD), or the changed bytes of a page (PAGE_RECORD).
+// a data file is named by a FILE_RECORD before its first PAGE_RECORD
+// since the last checkpoint, and is referred to by its number after that.
+//
+static const int FILE_RECORD = 1;
+static const int PAGE_RECORD = 2;
+
+struct WriteAheadLog::RecordHeader {
+  unsigned int checksum;  // CRC-32 of the rest of the record
+  unsigned int length;    // # bytes of the record, header included
+  Lsn  lsn;               // position of the record in the log
+  int  type;              // FILE_RECORD or PAGE_RECORD
+  int  file;              // the number of the data file
+  int  pid;               // the page written (PAGE_RECORD)
+  int  pageSize;          // the page size of the file (PAGE_RECORD)
+  int  offset;            // where the changed bytes start in the page
+  int  size;              // # bytes after the header
+};
+
+// the table of the CRC-32 (IEEE 802.3) polynomial
+struct CrcTable {
+  unsigned int entry[256];
+  CrcTable() {
+    for (unsigned int i = 0; i < 256; i++) {
+      unsigned int c = i;
+      for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+      entry[i] = c;
+    }
+  }
+};
+
+static unsigned int crc32(unsigned int crc, const void* data, size_t size)
+{
+  static const CrcTable table;
+  const unsigned char* p = (const unsigned char*)data;
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) crc = table.entry[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+WriteAheadLog::WriteAheadLog()
+{
+  fd = -1;
+  stopping = false;
+  appendLsn = durableLsn = forceLsn = fileStart = 0;
+  error = 0;
+  waiting = 0;
+  groupStart = 0;
+  groupSize = DEFAULT_GROUP_SIZE;
+  groupLatency = DEFAULT_GROUP_LATENCY;
+  checkpointSize = DEFAULT_CHECKPOINT_SIZE;
+  records = commits = syncs = checkpoints = 0;
+  pthread_rwlock_init(&checkpointLatch, NULL);
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+  // the buffer pool may be gone at exit, so no checkpoint is taken here.
+  // whatever is in the log is replayed when it is opened again
+  if (writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(latch);
+      stopping = true;
+    }
+    wakeWriter.notify_one();
+    writer.join();
+  }
+  if (fd >= 0) ::close(fd);
+  pthread_rwlock_destroy(&checkpointLatch);
+}
+
+WriteAheadLog& WriteAheadLog::global()
+{
+  static WriteAheadLog log;
+  return log;
+}
+
+RC WriteAheadLog::open(const string& filename)
+{
+  RC rc;
+
+  if (fd >= 0) return RC_FILE_OPEN_FAILED;
+  fd = ::open(filename.c_str(), O_RDWR|O_CREAT, 0644);
+  if (fd < 0) { fd = -1; return RC_FILE_OPEN_FAILED; }
+  this->filename = filename;
+
+  // bring the data files up to date with what the log says
+  if ((rc = recover()) < 0) {
+    ::close(fd);
+    fd = -1;
+    return rc;
+  }
+
+  stopping = false;
+  error = 0;
+  writer = std::thread(&WriteAheadLog::writerLoop, this);
+  return 0;
+}
+
+RC WriteAheadLog::close()
+{
+  RC rc;
+
+  if (fd < 0) return RC_FILE_CLOSE_FAILED;
+  rc = checkpoint();
+
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    stopping = true;
+  }
+  wakeWriter.notify_one();
+  writer.join();
+
+  ::close(fd);
+  fd = -1;
+  return rc;
+}
+
+void WriteAheadLog::setGroupCommit(int size, int latency)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  groupSize = (size < 1) ? 1 : size;
+  groupLatency = (latency < 0) ? 0 : latency;
+}
+
+void WriteAheadLog::appendRecord(int type, int file, PageId pid, int pageSize,
+                                 int offset, const void* data, int size)
+{
+  RecordHeader h;
+  memset(&h, 0, sizeof(h));
+  h.length = sizeof(h) + size;
+  h.lsn = appendLsn;
+  h.type = type;
+  h.file = file;
+  h.pid = pid;
+  h.pageSize = pageSize;
+  h.offset = offset;
+  h.size = size;
+  h.checksum = crc32(crc32(0, (char*)&h + sizeof(h.checksum), sizeof(h) - sizeof(h.checksum)), data, size);
+
+  size_t end = buffer.size();
+  buffer.resize(end + h.length);
+  memcpy(&buffer[end], &h, sizeof(h));
+  memcpy(&buffer[end + sizeof(h)], data, size);
+  appendLsn += h.length;
+}
+
+RC WriteAheadLog::append(const string& file, PageId pid, int pageSize, int offset,
+                         const void* data, int size, Lsn& lsn)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (fd < 0) return RC_FILE_WRITE_FAILED;
+  if (error < 0) return error;
+
+  // name the file the first time it shows up in the log
+  int number;
+  std::unordered_map<string, int>::iterator it = fileNumbers.find(file);
+  if (it == fileNumbers.end()) {
+    number = fileNumbers.size();
+    fileNumbers[file] = number;
+    appendRecord(FILE_RECORD, number, 0, 0, 0, file.data(), file.size());
+  } else {
+    number = it->second;
+  }
+
+  appendRecord(PAGE_RECORD, number, pid, pageSize, offset, data, size);
+  records++;
+  lsn = appendLsn;
+
+  // do not let the buffer grow without bound when nobody commits
+  if (buffer.size() >= (size_t)BUFFER_SIZE) wakeWriter.notify_one();
+  return 0;
+}
+
+RC WriteAheadLog::commit(Lsn lsn)
+{
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    commits++;
+  }
+  return waitDurable(lsn, false);
+}
+
+RC WriteAheadLog::flush(Lsn lsn)
+{
+  return waitDurable(lsn, true);
+}
+
+RC WriteAheadLog::waitDurable(Lsn lsn, bool force)
+{
+  std::unique_lock<std::mutex> guard(latch);
+  while (durableLsn < lsn && error == 0) {
+    if (force) {
+      if (forceLsn < lsn) forceLsn = lsn;
+    } else if (waiting++ == 0) {
+      groupStart = IOStats::now();
+    }
+    wakeWriter.notify_one();
+    durable.wait(guard);
+  }
+  return error;
+}
+
+void WriteAheadLog::writerLoop()
+{
+  std::unique_lock<std::mutex> guard(latch);
+  std::vector<char> out;
+
+  for (;;) {
+    // wait until there is a reason to write: a flush(), a full group,
+    // a group that has waited long enough, or a full buffer
+    while (!buffer.empty() || !stopping) {
+      if (!buffer.empty()) {
+        if (stopping || forceLsn > durableLsn || waiting >= groupSize ||
+            buffer.size() >= (size_t)BUFFER_SIZE) break;
+        if (waiting > 0) {
+          long long left = groupStart + groupLatency * 1000LL - IOStats::now();
+          if (left <= 0) break;
+          wakeWriter.wait_for(guard, std::chrono::nanoseconds(left));
+          continue;
+        }
+      }
+      wakeWriter.wait(guard);
+    }
+    if (buffer.empty()) return;
+
+    // write the buffered records at the end of the log and fsync them.
+    // new records are appended to the buffer in the meantime
+    out.swap(buffer);
+    Lsn end = appendLsn;
+    off_t offset = durableLsn - fileStart;
+    guard.unlock();
+
+    RC rc = 0;
+    size_t done = 0;
+    while (done < out.size()) {
+      ssize_t n = ::pwrite(fd, &out[done], out.size() - done, offset + done);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) { rc = RC_FILE_WRITE_FAILED; break; }
+      done += n;
+    }
+    if (rc == 0 && ::fdatasync(fd) < 0) rc = RC_FILE_WRITE_FAILED;
+    out.clear();
+
+    guard.lock();
+    if (rc < 0) {
+      error = rc;
+    } else {
+      durableLsn = end;
+    }
+    syncs++;
+    waiting = 0;     // the commits still waiting join the next group
+    durable.notify_all();
+  }
+}
+
+RC WriteAheadLog::checkpoint()
+{
+  RC rc = 0;
+  std::lock_guard<std::mutex> one(checkpointMutex);
+  if (fd < 0) return 0;
+
+  // no page write may be logged until the log is emptied
+  pthread_rwlock_wrlock(&checkpointLatch);
+
+  std::set<PageFile*> open;
+  std::vector<int> closed;
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    open = files;
+    closed.swap(unsynced);
+  }
+
+  // write the dirty pages of the open files and fsync them. a page is
+  // written only after its log records are durable (see PageFile)
+  for (std::set<PageFile*>::iterator it = open.begin(); it != open.end(); ++it) {
+    RC r = (*it)->sync();
+    if (r < 0) rc = r;
+  }
+
+  // the pages of the closed files have been written. fsync them
+  std::vector<int> failed;
+  for (unsigned i = 0; i < closed.size(); i++) {
+    if (::fdatasync(closed[i]) < 0) {
+      rc = RC_FILE_WRITE_FAILED;
+      failed.push_back(closed[i]);
+    } else {
+      ::close(closed[i]);
+    }
+  }
+
+  // every logged write is in the data files now. empty the log
+  Lsn end;
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    end = appendLsn;
+  }
+  if (rc == 0) rc = waitDurable(end, true);
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    if (rc == 0) {
+      if (::ftruncate(fd, 0) < 0 || ::fsync(fd) < 0) {
+        rc = RC_FILE_WRITE_FAILED;
+      } else {
+        fileStart = appendLsn;
+        fileNumbers.clear();
+        checkpoints++;
+      }
+    }
+    unsynced.insert(unsynced.end(), failed.begin(), failed.end());
+  }
+
+  pthread_rwlock_unlock(&checkpointLatch);
+  return rc;
+}
+
+bool WriteAheadLog::needsCheckpoint()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return fd >= 0 && appendLsn - fileStart >= checkpointSize;
+}
+
+void WriteAheadLog::addFile(PageFile* pf)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  files.insert(pf);
+}
+
+void WriteAheadLog::removeFile(PageFile* pf, int fd)
+{
+  // a checkpoint in progress may be using pf
+  std::lock_guard<std::mutex> one(checkpointMutex);
+  std::lock_guard<std::mutex> guard(latch);
+  files.erase(pf);
+  if (fd >= 0) unsynced.push_back(fd);
+}
+
+RC WriteAheadLog::recover()
+{
+  RC rc = 0;
+  struct stat statbuf;
+
+  if (::fstat(fd, &statbuf) < 0) return RC_FILE_READ_FAILED;
+  if (statbuf.st_size == 0) return 0;
+
+  std::vector<char> log(statbuf.st_size);
+  if (::pread(fd, &log[0], log.size(), 0) != (ssize_t)log.size()) return RC_FILE_READ_FAILED;
+
+  // replay the records up to the first one that is torn or stale
+  std::vector<string> names;
+  std::map<int, PageFile*> data;
+  char page[PageFile::MAX_PAGE_SIZE];
+  size_t pos = 0;
+  Lsn next = -1;
+  int replayed = 0;
+  while (pos + sizeof(RecordHeader) <= log.size()) {
+    RecordHeader h;
+    memcpy(&h, &log[pos], sizeof(h));
+    if (h.length < sizeof(h) || pos + h.length > log.size() ||
+        h.size != (int)(h.length - sizeof(h))) break;
+    if (crc32(crc32(0, (char*)&h + sizeof(h.checksum), sizeof(h) - sizeof(h.checksum)),
+              &log[pos + sizeof(h)], h.size) != h.checksum) break;
+    if (next >= 0 && h.lsn != next) break;
+    next = h.lsn + h.length;
+
+    const char* payload = &log[pos + sizeof(h)];
+    pos += h.length;
+
+    if (h.type == FILE_RECORD) {
+      if (h.file < 0) break;
+      if ((int)names.size() <= h.file) names.resize(h.file + 1);
+      names[h.file] = string(payload, h.size);
+      continue;
+    }
+    if (h.type != PAGE_RECORD || h.file < 0 || h.file >= (int)names.size()) break;
+
+    PageFile*& pf = data[h.file];
+    if (pf == NULL) {
+      pf = new PageFile();
+      if ((rc = pf->open(names[h.file], 'w', 0, h.pageSize)) < 0) break;
+    }
+    if (h.pid < 0 || h.offset < 0 || h.offset + h.size > pf->getPageSize()) break;
+
+    // apply the changed bytes to the page
+    if (h.pid < pf->endPid()) {
+      if ((rc = pf->read(h.pid, page)) < 0) break;
+    } else {
+      memset(page, 0, pf->getPageSize());
+    }
+    memcpy(page + h.offset, payload, h.size);
+    if ((rc = pf->write(h.pid, page)) < 0) break;
+    replayed++;
+  }
+
+  // the data files must be durable before the log can go
+  for (std::map<int, PageFile*>::iterator it = data.begin(); it != data.end(); ++it) {
+    RC r = it->second->sync();
+    if (r < 0 && rc == 0) rc = r;
+    it->second->close();
+    delete it->second;
+  }
+  if (rc < 0) return rc;
+
+  if (replayed > 0) {
+    fprintf(stderr, "Replayed %d log records from %s\n", replayed, filename.c_str());
+  }
+
+  if (::ftruncate(fd, 0) < 0 || ::fsync(fd) < 0) return RC_FILE_WRITE_FAILED;
+  return 0;
+}
+
+void WriteAheadLog::printStats(FILE* out)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  fprintf(out, "log: %lld page records, %lld commits, %lld fsyncs, %lld checkpoints, "
+          "%lld bytes since the last checkpoint\n",
+          records, commits, syncs, checkpoints, appendLsn - fileStart);
+}
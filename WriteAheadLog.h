@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+typedef long long Lsn;   // log sequence number: a position in the log
+
+/**
+ * The write-ahead log of the PageFiles opened with PageFile::LOGGED.
+ * A page write appends a log record with the bytes that changed in the
+ * page and leaves the page dirty in the buffer pool. The log is written
+ * sequentially and fsynced in groups: a commit waits until the group
+ * is full (setGroupCommit()) or until it has waited long enough, and
+ * one fsync makes the whole group durable. The data pages reach the
+ * disk lazily, when they are evicted or at a checkpoint, and a page is
+ * written to its file only after the log records that changed it are
+ * on disk. A checkpoint writes and fsyncs the dirty pages of the logged
+ * files and empties the log. When the log is opened, the records left
+ * by a crash are replayed into the data files.
+ * A log record carries absolute bytes, so replaying a record twice, or
+ * over a page that already has it, is harmless.
+ */
+class WriteAheadLog {
+ public:
+  static const int DEFAULT_GROUP_SIZE = 8;       // # commits per fsync
+  static const int DEFAULT_GROUP_LATENCY = 1000; // max us a commit waits
+                                                 // for the group to fill
+  static const long long DEFAULT_CHECKPOINT_SIZE = 64LL << 20; // log size
+                                                 // that triggers a checkpoint
+  static const int BUFFER_SIZE = 1 << 20;  // log bytes buffered in memory
+                                           // before they are written anyway
+
+  WriteAheadLog();
+  ~WriteAheadLog();
+
+  /**
+   * the log used by every PageFile in this process.
+   */
+  static WriteAheadLog& global();
+
+  /**
+   * open the log file, replay the records left in it into the data
+   * files, and start the thread that writes the log.
+   * @param filename[IN] the name of the log file
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& filename);
+
+  /**
+   * take a checkpoint and close the log. no logged PageFile may be open.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * @return true if the log is open
+   */
+  bool isOpen() const { return fd >= 0; }
+
+  /**
+   * set how commits are grouped into one fsync.
+   * @param size[IN] # commits that make a group. 1 syncs every commit
+   * @param latency[IN] max # microseconds a commit waits for the group
+   */
+  void setGroupCommit(int size, int latency);
+
+  /**
+   * @param bytes[IN] the log size that triggers a checkpoint
+   */
+  void setCheckpointSize(long long bytes) { checkpointSize = bytes; }
+
+  /**
+   * append a log record of a page write. the caller must hold the
+   * checkpoint latch through beginWrite() until the page is in the
+   * buffer pool.
+   * @param file[IN] the absolute path of the data file
+   * @param pid[IN] the page written
+   * @param pageSize[IN] the page size of the file
+   * @param offset[IN] where the changed bytes start in the page
+   * @param data[IN] the changed bytes
+   * @param size[IN] # changed bytes
+   * @param lsn[OUT] the end of the record in the log
+   * @return error code. 0 if no error
+   */
+  RC append(const std::string& file, PageId pid, int pageSize, int offset,
+            const void* data, int size, Lsn& lsn);
+
+  /**
+   * hold off checkpoints while a page write is logged and cached.
+   */
+  void beginWrite() { pthread_rwlock_rdlock(&checkpointLatch); }
+  void endWrite() { pthread_rwlock_unlock(&checkpointLatch); }
+
+  /**
+   * wait until the log is durable up to lsn. the fsync is shared by the
+   * commits of a group.
+   * @param lsn[IN] the log position that has to be durable
+   * @return error code. 0 if no error
+   */
+  RC commit(Lsn lsn);
+
+  /**
+   * make the log durable up to lsn right away, without waiting for a
+   * group (e.g., before a dirty page is written to its data file).
+   * @param lsn[IN] the log position that has to be durable
+   * @return error code. 0 if no error
+   */
+  RC flush(Lsn lsn);
+
+  /**
+   * write and fsync the dirty pages of all logged files, and empty the log.
+   * @return error code. 0 if no error
+   */
+  RC checkpoint();
+
+  /**
+   * @return true if the log has grown enough for a checkpoint
+   */
+  bool needsCheckpoint();
+
+  /**
+   * register a logged PageFile, whose dirty pages a checkpoint writes.
+   */
+  void addFile(PageFile* pf);
+
+  /**
+   * unregister a logged PageFile that is being closed. its pages have
+   * been written, and fd (a duplicate of its descriptor, owned by the
+   * log from now on) is fsynced by the next checkpoint.
+   */
+  void removeFile(PageFile* pf, int fd);
+
+  /**
+   * print the counters of the log.
+   */
+  void printStats(FILE* out);
+
+ private:
+  struct RecordHeader;
+
+  // replay the records in the log file into the data files
+  RC recover();
+
+  // the thread that writes and fsyncs the log
+  void writerLoop();
+
+  // wait until the log is durable up to lsn. with force, the group is
+  // not waited for
+  RC waitDurable(Lsn lsn, bool force);
+
+  // append a record with the latch held
+  void appendRecord(int type, int file, PageId pid, int pageSize,
+                    int offset, const void* data, int size);
+
+  std::string filename;
+  int  fd;              // the log file. -1 if the log is not open
+
+  std::mutex latch;     // protects everything below
+  std::condition_variable wakeWriter; // work for the writer thread
+  std::condition_variable durable;    // the durable lsn has moved
+  std::thread writer;
+  bool stopping;        // the writer thread is asked to stop
+
+  std::vector<char> buffer;  // records appended but not written yet
+  Lsn  appendLsn;       // end of the appended records
+  Lsn  durableLsn;      // end of the durable records
+  Lsn  forceLsn;        // flush() wants the log durable up to here
+  Lsn  fileStart;       // lsn of the first byte of the log file
+  RC   error;           // the write or fsync of the log failed
+
+  int  waiting;         // # commits waiting for the group to fill
+  long long groupStart; // when the first commit of the group arrived
+  int  groupSize;
+  int  groupLatency;    // in microseconds
+  long long checkpointSize;
+
+  std::unordered_map<std::string, int> fileNumbers; // files in the log
+  std::set<PageFile*> files;  // open logged files
+  std::vector<int> unsynced;  // fds of closed logged files to fsync
+
+  // held shared while a page write is logged and cached, and
+  // exclusively by a checkpoint
+  pthread_rwlock_t checkpointLatch;
+  std::mutex checkpointMutex; // one checkpoint at a time
+
+  // counters
+  long long records;    // # page records appended
+  long long commits;    // # commit() calls
+  long long syncs;      // # fsyncs of the log
+  long long checkpoints; // # checkpoints taken
+
+  WriteAheadLog(const WriteAheadLog&);
+  WriteAheadLog& operator=(const WriteAheadLog&);
+};
+
+#endif // WRITEAHEADLOG_H
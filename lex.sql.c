@@ -942,6 +942,13 @@ sqllval.string = strdup(sqltext+1); sqllval.string[sqlleng-2] = 0; return STRING
 case 20:
 YY_RULE_SETUP
 #line 40 "SqlParser.l"
+if (!strcmp(sqltext, "STATS") || !strcmp(sqltext, "stats")) return STATS; /* STATS|stats */
+if (!strcmp(sqltext, "UPDATE") || !strcmp(sqltext, "update")) return UPDATE; /* UPDATE|update */
+if (!strcmp(sqltext, "SET") || !strcmp(sqltext, "set")) return SET; /* SET|set */
+if (!strcmp(sqltext, "DELETE") || !strcmp(sqltext, "delete")) return DELETE; /* DELETE|delete */
+if (!strcmp(sqltext, "COMPACT") || !strcmp(sqltext, "compact")) return COMPACT; /* COMPACT|compact */
+if (!strcmp(sqltext, "CREATE") || !strcmp(sqltext, "create")) return CREATE; /* CREATE|create */
+if (!strcmp(sqltext, "ON") || !strcmp(sqltext, "on")) return ON; /* ON|on */
 sqllval.string = strlower(strdup(sqltext)); return ID;
 	YY_BREAK
 case 21:
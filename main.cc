@@ -9,12 +9,152 @@
  
 #include "Bruinbase.h"
 #include "SqlEngine.h"
+#include "BufferPool.h"
+#include "WriteAheadLog.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
 
-int main()
+// the write-ahead log of the files written with -l
+static const char* LOG_FILE = "bruinbase.wal";
+
+static void usage(const char* prog)
 {
+  fprintf(stderr, "usage: %s [-b frames] [-c] [-C] [-d] [-e lru|2q|cost] [-g size,usec] [-H]\n"
+                  "          [-l] [-m] [-M megabytes] [-p bytes] [-r pages] [-s] [-x pages]\n", prog);
+  fprintf(stderr, "  -b frames   # of 1KB page frames in the buffer pool (default %d)\n",
+          BufferPool::DEFAULT_FRAME_COUNT);
+  fprintf(stderr, "  -c          compress the tables created by LOAD\n");
+  fprintf(stderr, "  -C          store the keys and the values of the tables created by LOAD\n"
+                  "              in separate column files\n");
+  fprintf(stderr, "  -d          bypass the kernel page cache (O_DIRECT)\n");
+  fprintf(stderr, "  -e policy   buffer pool replacement policy: lru, 2q or cost (default 2q)\n");
+  fprintf(stderr, "  -g size,usec  group commit: # commits per log fsync, and max wait in us\n"
+                  "              (default %d,%d)\n",
+          WriteAheadLog::DEFAULT_GROUP_SIZE, WriteAheadLog::DEFAULT_GROUP_LATENCY);
+  fprintf(stderr, "  -H          back the buffer pool with huge pages\n");
+  fprintf(stderr, "  -l          log the writes of LOAD in the write-ahead log %s\n", LOG_FILE);
+  fprintf(stderr, "  -m          read tables and indexes through mmap\n");
+  fprintf(stderr, "  -M megabytes  memory budget of the buffer pool (overrides -b)\n");
+  fprintf(stderr, "  -p bytes    page size of the files created by LOAD (%d to %d, default %d)\n",
+          PageFile::PAGE_SIZE, PageFile::MAX_PAGE_SIZE, PageFile::PAGE_SIZE);
+  fprintf(stderr, "  -r pages    read-ahead window for sequential scans (default %d, 0 disables)\n",
+          PageFile::DEFAULT_READ_AHEAD);
+  fprintf(stderr, "  -s          store the tables created by LOAD in slotted pages of\n"
+                  "              variable-length records\n");
+  fprintf(stderr, "  -x pages    min disk space reserved when a file grows (default %d, 0 disables)\n",
+          PageFile::DEFAULT_EXTENT);
+}
+
+int main(int argc, char* argv[])
+{
+  int opt;
+  int flags = 0;
+  size_t budget = 0;
+  bool hugePages = false;
+
+  // parse the command line options
+  while ((opt = getopt(argc, argv, "b:cCde:g:HlmM:p:r:sx:")) != -1) {
+    switch (opt) {
+    case 'b':
+      if (BufferPool::global().resize(atoi(optarg)) < 0) {
+        fprintf(stderr, "Error: invalid buffer pool size %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'c':
+      flags |= PageFile::COMPRESS;
+      break;
+    case 'C':
+      SqlEngine::setRecordFormat(RecordFile::COLUMNAR);
+      break;
+    case 'd':
+      flags |= PageFile::DIRECT;
+      break;
+    case 'e':
+      if (strcmp(optarg, "lru") == 0) {
+        BufferPool::global().setPolicy(BufferPool::LRU);
+      } else if (strcmp(optarg, "2q") == 0) {
+        BufferPool::global().setPolicy(BufferPool::TWO_Q);
+      } else if (strcmp(optarg, "cost") == 0) {
+        BufferPool::global().setPolicy(BufferPool::COST);
+      } else {
+        fprintf(stderr, "Error: unknown replacement policy %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'g': {
+      int size, latency;
+      if (sscanf(optarg, "%d,%d", &size, &latency) != 2 || size < 1 || latency < 0) {
+        fprintf(stderr, "Error: invalid group commit %s\n", optarg);
+        return 1;
+      }
+      WriteAheadLog::global().setGroupCommit(size, latency);
+      break;
+    }
+    case 'H':
+      hugePages = true;
+      break;
+    case 'l':
+      flags |= PageFile::LOGGED;
+      break;
+    case 'm':
+      flags |= PageFile::MMAP;
+      break;
+    case 'M':
+      if (atoi(optarg) <= 0) {
+        fprintf(stderr, "Error: invalid memory budget %s\n", optarg);
+        return 1;
+      }
+      budget = (size_t)atoi(optarg) << 20;
+      break;
+    case 'p':
+      if (SqlEngine::setPageSize(atoi(optarg)) < 0) {
+        fprintf(stderr, "Error: invalid page size %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'r':
+      PageFile::setReadAheadWindow(atoi(optarg));
+      break;
+    case 's':
+      SqlEngine::setRecordFormat(RecordFile::SLOTTED);
+      break;
+    case 'x':
+      PageFile::setExtentSize(atoi(optarg));
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if ((flags & PageFile::MMAP) && (flags & PageFile::DIRECT)) {
+    fprintf(stderr, "Error: -d and -m cannot be used together\n");
+    return 1;
+  }
+  if (budget > 0 || hugePages) {
+    BufferPool& pool = BufferPool::global();
+    pool.setMemoryBudget((budget > 0) ? budget : pool.getCapacity(), hugePages);
+  }
+
+  if ((flags & PageFile::MMAP) && (flags & PageFile::LOGGED)) {
+    fprintf(stderr, "Error: -l and -m cannot be used together\n");
+    return 1;
+  }
+
+  // replay what a crash left in the log before any file is used
+  if ((flags & PageFile::LOGGED) && WriteAheadLog::global().open(LOG_FILE) < 0) {
+    fprintf(stderr, "Error: cannot open the log %s\n", LOG_FILE);
+    return 1;
+  }
+  SqlEngine::setReadFlags(flags);
+
   // run the SQL engine taking user commands from standard input (console).
   SqlEngine::run(stdin);
 
+  if (WriteAheadLog::global().isOpen()) WriteAheadLog::global().close();
+
   return 0;
 }